@@ -4,19 +4,36 @@
 #include<cstring>   //memcpy
 #include<vector>
 #include<iostream>
+#include<algorithm>
+#include "utils.h"
 
 namespace zmat{
 
+/*how Matrix::map_file maps its file.*/
+enum MapMode{
+    MAP_MODE_READ = 0,      //read-only, writing to the matrix faults
+    MAP_MODE_SHARED,        //read-write, writes go to the file; created or extended as needed
+    MAP_MODE_PRIVATE        //copy-on-write, writes stay in memory
+};
+
 namespace internal{
 
 template<class _Ty>
 struct MatrixData;
 
 template<>
-struct MatrixData<void>{
+struct MatrixData<void>: public std::enable_shared_from_this<MatrixData<void>>{
     virtual ~MatrixData(){}
     
     virtual std::shared_ptr<MatrixData<void>> clone() const = 0;
+
+    /*paging hint for [ptr, ptr + bytes): about to be read, or not needed for a while.*/
+    virtual void advise(const void* /*ptr*/, size_t /*bytes*/, bool /*will_need*/) const{}
+
+    /*whether the storage belongs to this manager alone (not borrowed or mapped), so it may be rearranged in place.*/
+    virtual bool owns_storage() const{
+        return false;
+    }
     void* get_data() const {
         return data;
     }
@@ -36,12 +53,20 @@ private:
     using self = MatrixData<_Ty>;
 
     size_t size;
+    size_t align = 0;   //alignment of our own allocation, 0 for an adopted pointer
+    mat_allocator alloc;
+
+    void allocate(size_t size){
+        this->size = size;
+        align = std::max(mat_get_alignment(), alignof(_Ty));
+        alloc = mat_get_allocator();
+        data = alloc.allocate(size * sizeof(_Ty), align);
+    }
 
 public:
     template<class ...Types>
-    MatrixData(size_t size, Types&& ...args):size(size){
-        std::allocator<_Ty> alloc;
-        data = reinterpret_cast<void*>(alloc.allocate(size));
+    MatrixData(size_t size, Types&& ...args){
+        allocate(size);
         _construct_in_range(get_data(), get_data() + size, std::forward<Types>(args)...);
     }
 
@@ -49,21 +74,19 @@ public:
         data = nullptr;
     }
 
-    MatrixData(size_t size, const _Ty* src): size(size){
+    MatrixData(size_t size, const _Ty* src){
         if(src == nullptr)
             throw std::runtime_error("copy from a null pointer");
-        std::allocator<_Ty> alloc;
-        data = reinterpret_cast<void*>(alloc.allocate(size));
-        std::copy(src, src + size, get_data());
+        allocate(size);
+        std::uninitialized_copy_n(src, size, get_data());
     }
 
     MatrixData(size_t size, _Ty* src, bool clone = true): size(size){
         if(src == nullptr)
             throw std::runtime_error("copy from a null pointer");
         if(clone){
-            std::allocator<_Ty> alloc;
-            data = reinterpret_cast<void*>(alloc.allocate(size));
-            std::copy(src, src + size, get_data());
+            allocate(size);
+            std::uninitialized_copy_n(src, size, get_data());
         }else{
             data = src;
         }
@@ -71,9 +94,13 @@ public:
 
     ~MatrixData(){
         if(data != nullptr){
-            std::allocator<_Ty> alloc;
             std::destroy_n(get_data(), size);
-            alloc.deallocate(get_data(), size);
+            if(align != 0){
+                alloc.deallocate(data, size * sizeof(_Ty), align);
+            }else{
+                std::allocator<_Ty> alloc;
+                alloc.deallocate(get_data(), size);
+            }
         }
     }
 
@@ -85,22 +112,75 @@ public:
         return std::make_shared<self>(size, get_data());
     }
 
+    bool owns_storage() const override{
+        return true;
+    }
+
     void allocate_uninitialized(size_t size){
-        this->size = size;
-        std::allocator<_Ty> alloc;
-        data = reinterpret_cast<void*>(alloc.allocate(size));
+        allocate(size);
     }
 
 private:
     template<class ...Types>
     void _construct_in_range(pointer L, pointer R, Types&& ...args) const{
-        std::allocator<_Ty> alloc;
         for(auto ptr = L; ptr != R; ++ptr){
-            alloc.construct(ptr, std::forward<Types>(args)...);
+            std::construct_at(ptr, args...);
         }
     }
 };
 
+/*storage owned elsewhere (e.g. by an SMatrix), never freed here; clone() makes an owning copy.*/
+template<class _Ty>
+struct BorrowedData: public MatrixData<void>{
+    BorrowedData(size_t size, _Ty* ptr): size(size){
+        data = ptr;
+    }
+
+    data_manager clone() const override{
+        return std::make_shared<MatrixData<_Ty>>(size, static_cast<const _Ty*>(data));
+    }
+
+private:
+    size_t size;
+};
+
+/*map bytes of path starting at offset, the mapping is released with unmap_file(base, length).*/
+void* map_file(const std::string& path, size_t offset, size_t bytes, MapMode mode, void*& base, size_t& length);
+void unmap_file(void* base, size_t length);
+size_t file_size(const std::string& path);
+/*madvise the pages covering [ptr, ptr + bytes) with WILLNEED, or DONTNEED.*/
+void advise_mapping(const void* ptr, size_t bytes, bool will_need);
+
+/*storage backed by a memory-mapped file; clone() makes an owning heap copy.*/
+template<class _Ty>
+struct MappedData: public MatrixData<void>{
+    static_assert(std::is_trivially_copyable_v<_Ty>, "only trivially copyable types can be mapped");
+
+    MappedData(const std::string& path, size_t size, size_t offset, MapMode mode): size(size), mode(mode){
+        data = map_file(path, offset, size * sizeof(_Ty), mode, base, length);
+    }
+
+    ~MappedData(){
+        unmap_file(base, length);
+    }
+
+    /*dropping written copy-on-write pages would lose the writes, so those are kept.*/
+    void advise(const void* ptr, size_t bytes, bool will_need) const override{
+        if(will_need || mode != MAP_MODE_PRIVATE)
+            advise_mapping(ptr, bytes, will_need);
+    }
+
+    data_manager clone() const override{
+        return std::make_shared<MatrixData<_Ty>>(size, static_cast<const _Ty*>(data));
+    }
+
+private:
+    size_t size;
+    MapMode mode;
+    void* base;
+    size_t length;
+};
+
 template<class _Ty, class ...Types>
 data_manager make_manager(Types ...args){
     return std::make_shared<MatrixData<_Ty>>(std::forward<Types>(args)...);
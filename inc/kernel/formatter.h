@@ -2,8 +2,12 @@
 
 #include<string>
 #include<sstream>
+#include<cctype>
+#include<charconv>
+#include<stdexcept>
 #include<type_traits>
 #include<functional>
+#include "half.h"
 
 namespace zmat{
 
@@ -26,12 +30,40 @@ public:
 template<class _Ty>
 constexpr bool is_printable_v = is_printable<_Ty>::value;
 
+/*types that std::to_chars formats the way operator<< does; chars and bool are not among them.*/
+template<class _Ty>
+constexpr bool is_charconv_v = std::is_floating_point_v<_Ty> || (std::is_integral_v<_Ty> && !std::is_same_v<_Ty, bool>
+                                && !std::is_same_v<_Ty, char> && !std::is_same_v<_Ty, signed char> && !std::is_same_v<_Ty, unsigned char>);
+
+/*append std::to_chars(val, args...) to buf.*/
+template<class _Ty, class ...Args>
+void append_chars(std::string& buf, _Ty val, Args ...args){
+    char tmp[128];
+    auto [end, ec] = std::to_chars(tmp, tmp + sizeof(tmp), val, args...);
+    if(ec == std::errc()){
+        buf.append(tmp, end);
+        return;
+    }
+    /*only fixed notation of huge values gets here.*/
+    size_t old = buf.size();
+    for(size_t cap = 1024;; cap *= 2){
+        buf.resize(old + cap);
+        auto [end, ec] = std::to_chars(buf.data() + old, buf.data() + buf.size(), val, args...);
+        if(ec == std::errc()){
+            buf.resize(end - buf.data());
+            return;
+        }
+    }
+}
+
 } // namespace internal
 
 
 template<class _Ty>
 struct formatter{
-    size_t max_items = 6;   //maximum # of display item.
+    static constexpr size_t no_limit = -1;
+
+    size_t max_items = 6;   //maximum # of display item, no_limit to print all of them.
     size_t front_items = 3;
     size_t back_items = 3;
 
@@ -42,45 +74,152 @@ struct formatter{
     bool recursive = false;
     bool binary = false;
 
+    virtual ~formatter() = default;
+
     virtual std::string to_string(const _Ty& val){
         return "undefined";
     };
+
+    /*append the n items ptr[0], ptr[step], ... to buf, separated by del.*/
+    virtual void write(std::string& buf, const _Ty* ptr, size_t n, size_t step){
+        for(size_t i = 0; i < n; ++i){
+            if(i)
+                buf += del;
+            buf += to_string(ptr[i * step]);
+        }
+    }
 };
 
 template<class _Ty>
 struct default_fmt: formatter<_Ty>{
 
     std::string to_string(const _Ty& val) override{
-        std::stringstream ss;
-        ss << val;
-        return ss.str();
+        std::string res;
+        write(res, &val, 1, 1);
+        return res;
     };
+
+    /*same text as operator<< on a default stream, numbers go through std::to_chars.*/
+    void write(std::string& buf, const _Ty* ptr, size_t n, size_t step) override{
+        if constexpr(internal::is_half_v<_Ty>){
+            for(size_t i = 0; i < n; ++i){
+                if(i)
+                    buf += this->del;
+                internal::append_chars(buf, static_cast<float>(ptr[i * step]), std::chars_format::general, 6);
+            }
+        }else if constexpr(internal::is_charconv_v<_Ty>){
+            for(size_t i = 0; i < n; ++i){
+                if(i)
+                    buf += this->del;
+                if constexpr(std::is_floating_point_v<_Ty>)
+                    internal::append_chars(buf, ptr[i * step], std::chars_format::general, 6);
+                else
+                    internal::append_chars(buf, ptr[i * step]);
+            }
+        }else{
+            std::ostringstream ss;
+            for(size_t i = 0; i < n; ++i){
+                if(i)
+                    ss << this->del;
+                ss << ptr[i * step];
+            }
+            buf += ss.str();
+        }
+    }
 };
 
+/*
+    fmt is a printf-like conversion: "" for the shortest text that reads
+    back to the same value, "f", "e" or "g" with an optional precision
+    such as ".3f" for fixed, scientific or general notation. 16-bit floats
+    are written as the floats they convert to.
+*/
 template<class _Ty>
 struct float_fmt: formatter<_Ty>{
-static_assert(std::is_floating_point_v<_Ty>, "Requiring floating point type in float_fmt.");
+static_assert(std::is_floating_point_v<_Ty> || internal::is_half_v<_Ty>, "Requiring floating point type in float_fmt.");
 
     std::string fmt;
 
-    float_fmt(std::string fmt = ""): fmt(fmt){}
+    float_fmt(std::string fmt = ""): fmt(fmt){
+        if(fmt.empty())
+            return;
+        size_t pos = 0;
+        if(fmt[0] == '.'){
+            precision = 0;
+            for(pos = 1; pos < fmt.size() && isdigit(fmt[pos]); ++pos)
+                precision = precision * 10 + (fmt[pos] - '0');
+        }
+        if(pos + 1 != fmt.size())
+            throw std::invalid_argument("invalid float format '" + fmt + "'");
+        switch(fmt[pos]){
+            case 'f': mode = std::chars_format::fixed; break;
+            case 'e': mode = std::chars_format::scientific; break;
+            case 'g': mode = std::chars_format::general; break;
+            default: throw std::invalid_argument("invalid float format '" + fmt + "'");
+        }
+        if(precision < 0)
+            precision = 6;
+    }
 
-    std::string to_string(const _Ty& val){
-        return "TODO";
+    std::string to_string(const _Ty& val) override{
+        std::string res;
+        write(res, &val, 1, 1);
+        return res;
+    }
+
+    void write(std::string& buf, const _Ty* ptr, size_t n, size_t step) override{
+        for(size_t i = 0; i < n; ++i){
+            if(i)
+                buf += this->del;
+            auto val = static_cast<internal::compute_t<_Ty>>(ptr[i * step]);
+            if(fmt.empty())
+                internal::append_chars(buf, val);
+            else
+                internal::append_chars(buf, val, mode, precision);
+        }
     }
+
+private:
+    std::chars_format mode = std::chars_format::general;
+    int precision = -1;
 };
 
+/*fmt is the base: "" or "d" for decimal, "x", "o" and "b" for hexadecimal, octal and binary.*/
 template<class _Ty>
 struct integer_fmt: formatter<_Ty>{
-static_assert(std::is_integral_v<_Ty>, "Requiring floating point type in float_fmt.");
+static_assert(std::is_integral_v<_Ty> && !std::is_same_v<_Ty, bool>, "Requiring integral type in integer_fmt.");
 
     std::string fmt;
 
-    integer_fmt(std::string fmt = ""): fmt(fmt){}
+    integer_fmt(std::string fmt = ""): fmt(fmt){
+        if(fmt == "" || fmt == "d")
+            base = 10;
+        else if(fmt == "x")
+            base = 16;
+        else if(fmt == "o")
+            base = 8;
+        else if(fmt == "b")
+            base = 2;
+        else
+            throw std::invalid_argument("invalid integer format '" + fmt + "'");
+    }
+
+    std::string to_string(const _Ty& val) override{
+        std::string res;
+        write(res, &val, 1, 1);
+        return res;
+    }
 
-    std::string to_string(const _Ty& val){
-        return "TODO";
+    void write(std::string& buf, const _Ty* ptr, size_t n, size_t step) override{
+        for(size_t i = 0; i < n; ++i){
+            if(i)
+                buf += this->del;
+            internal::append_chars(buf, ptr[i * step], base);
+        }
     }
+
+private:
+    int base = 10;
 };
 
 template<class _Ty>
@@ -0,0 +1,614 @@
+#pragma once
+
+#include<cstddef>
+#include<new>
+#include<algorithm>
+#include<memory>
+#include<type_traits>
+#include "utils.h"
+#include "half.h"
+
+#ifdef _MAT_X86
+#include<immintrin.h>
+#endif
+
+namespace zmat{
+
+namespace internal{
+
+/*
+    Packed-panel GEMM (GotoBLAS layout).
+
+    C[M x N] += A[M x K] * B[K x N]
+
+    jc: NC columns of B/C
+      pc: KC depth, B[pc:pc+KC, jc:jc+NC] packed into NR-wide slivers
+        ic: MC rows, A[ic:ic+MC, pc:pc+KC] packed into MR-tall slivers
+          jr/ir: MR x NR register tile computed by the micro kernel
+
+    There is one driver per SimdLevel, the blocking and micro kernel of a
+    level are gemm_block<_Ty, L> and gemm_micro<_Ty, L>. gemm picks the
+    driver of simd_level() on every call.
+
+    16-bit float operands are widened to fp32 while packed, so they run on
+    the float kernels; C stays in its own type.
+*/
+
+constexpr size_t GEMM_ALIGN = 64;
+
+template<class _Ty, SimdLevel _L>
+struct gemm_block{
+    static constexpr size_t MR = 4;
+    static constexpr size_t NR = 8;
+    static constexpr size_t MC = 64;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 2048;
+};
+
+template<>
+struct gemm_block<float, SIMD_AVX2>{
+    static constexpr size_t MR = 6;
+    static constexpr size_t NR = 16;
+    static constexpr size_t MC = 168;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 4080;
+};
+
+template<>
+struct gemm_block<double, SIMD_AVX2>{
+    static constexpr size_t MR = 6;
+    static constexpr size_t NR = 8;
+    static constexpr size_t MC = 72;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 4080;
+};
+
+template<>
+struct gemm_block<float, SIMD_AVX512>{
+    static constexpr size_t MR = 12;
+    static constexpr size_t NR = 32;
+    static constexpr size_t MC = 144;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 4096;
+};
+
+template<>
+struct gemm_block<double, SIMD_AVX512>{
+    static constexpr size_t MR = 12;
+    static constexpr size_t NR = 16;
+    static constexpr size_t MC = 72;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 4080;
+};
+
+/*grow-only aligned buffer, one per thread and element type.*/
+template<class _Ty>
+struct gemm_scratch{
+    _Ty* ptr = nullptr;
+    size_t cap = 0;
+
+    gemm_scratch() = default;
+    gemm_scratch(const gemm_scratch&) = delete;
+    gemm_scratch& operator =(const gemm_scratch&) = delete;
+
+    _Ty* get(size_t n){
+        if(n > cap){
+            release();
+            ptr = static_cast<_Ty*>(::operator new(n * sizeof(_Ty), std::align_val_t(GEMM_ALIGN)));
+            cap = n;
+        }
+        return ptr;
+    }
+
+    void release(){
+        if(ptr != nullptr)
+            ::operator delete(ptr, std::align_val_t(GEMM_ALIGN));
+        ptr = nullptr;
+        cap = 0;
+    }
+
+    ~gemm_scratch(){
+        release();
+    }
+};
+
+/*dst[0:n] = src[0:n], converting to the compute type.*/
+template<class _Ty, class _Acc>
+void gemm_copy(const _Ty* src, size_t n, _Acc* dst){
+    if constexpr(is_half_v<_Ty>)
+        simd::widen(src, dst, n);
+    else
+        std::copy_n(src, n, dst);
+}
+
+/*pack A[mc x kc] (row stride rs, column stride cs) into MR-row slivers, zero padding the last one.*/
+template<size_t MR, class _Ty, class _Acc>
+void gemm_pack_a(const _Ty* a, size_t rs, size_t cs, size_t mc, size_t kc, _Acc* dst){
+    for(size_t ir = 0; ir < mc; ir += MR){
+        size_t mr = std::min(MR, mc - ir);
+        const _Ty* src = a + ir * rs;
+        if(mr == MR && rs == 1){
+            for(size_t k = 0; k < kc; ++k){
+                gemm_copy(src + k * cs, MR, dst);
+                dst += MR;
+            }
+            continue;
+        }
+        for(size_t k = 0; k < kc; ++k){
+            for(size_t i = 0; i < mr; ++i)
+                dst[i] = src[i * rs + k * cs];
+            for(size_t i = mr; i < MR; ++i)
+                dst[i] = _Acc();
+            dst += MR;
+        }
+    }
+}
+
+/*pack B[kc x nc] (row stride rs, column stride cs) into NR-column slivers, zero padding the last one.*/
+template<size_t NR, class _Ty, class _Acc>
+void gemm_pack_b(const _Ty* b, size_t rs, size_t cs, size_t kc, size_t nc, _Acc* dst){
+    for(size_t jr = 0; jr < nc; jr += NR){
+        size_t nr = std::min(NR, nc - jr);
+        const _Ty* src = b + jr * cs;
+        if(nr == NR && cs == 1){
+            for(size_t k = 0; k < kc; ++k){
+                gemm_copy(src + k * rs, NR, dst);
+                dst += NR;
+            }
+            continue;
+        }
+        for(size_t k = 0; k < kc; ++k){
+            for(size_t j = 0; j < nr; ++j)
+                dst[j] = src[k * rs + j * cs];
+            for(size_t j = nr; j < NR; ++j)
+                dst[j] = _Acc();
+            dst += NR;
+        }
+    }
+}
+
+/*C[MR x NR] += Ap * Bp, portable version, vectorized for the ISA of whatever it is inlined into.*/
+template<size_t MR, size_t NR, class _Ty>
+inline void gemm_micro_portable(size_t kc, const _Ty* a, const _Ty* b, _Ty* c, size_t ldc){
+    _Ty acc[MR][NR] = {};
+    for(size_t k = 0; k < kc; ++k){
+        for(size_t i = 0; i < MR; ++i){
+            _Ty av = a[i];
+            #pragma omp simd
+            for(size_t j = 0; j < NR; ++j)
+                acc[i][j] += av * b[j];
+        }
+        a += MR;
+        b += NR;
+    }
+    for(size_t i = 0; i < MR; ++i)
+        for(size_t j = 0; j < NR; ++j)
+            c[i * ldc + j] += acc[i][j];
+}
+
+template<class _Ty, SimdLevel _L>
+struct gemm_micro{
+    using blk = gemm_block<_Ty, _L>;
+
+    static void run(size_t kc, const _Ty* a, const _Ty* b, _Ty* c, size_t ldc){
+        gemm_micro_portable<blk::MR, blk::NR>(kc, a, b, c, ldc);
+    }
+};
+
+#ifdef _MAT_X86
+
+template<class _Ty>
+struct gemm_micro<_Ty, SIMD_SSE42>{
+    using blk = gemm_block<_Ty, SIMD_SSE42>;
+
+    _MAT_TARGET("sse4.2")
+    static void run(size_t kc, const _Ty* a, const _Ty* b, _Ty* c, size_t ldc){
+        gemm_micro_portable<blk::MR, blk::NR>(kc, a, b, c, ldc);
+    }
+};
+
+template<class _Ty>
+struct gemm_micro<_Ty, SIMD_AVX2>{
+    using blk = gemm_block<_Ty, SIMD_AVX2>;
+
+    _MAT_TARGET("avx2,fma")
+    static void run(size_t kc, const _Ty* a, const _Ty* b, _Ty* c, size_t ldc){
+        gemm_micro_portable<blk::MR, blk::NR>(kc, a, b, c, ldc);
+    }
+};
+
+template<class _Ty>
+struct gemm_micro<_Ty, SIMD_AVX512>{
+    using blk = gemm_block<_Ty, SIMD_AVX512>;
+
+    _MAT_TARGET("avx512f")
+    static void run(size_t kc, const _Ty* a, const _Ty* b, _Ty* c, size_t ldc){
+        gemm_micro_portable<blk::MR, blk::NR>(kc, a, b, c, ldc);
+    }
+};
+
+template<>
+struct gemm_micro<float, SIMD_AVX2>{
+    _MAT_TARGET("avx2,fma")
+    static void run(size_t kc, const float* a, const float* b, float* c, size_t ldc){
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+        for(size_t k = 0; k < kc; ++k){
+            __m256 b0 = _mm256_load_ps(b);
+            __m256 b1 = _mm256_load_ps(b + 8);
+            __m256 av;
+            av = _mm256_broadcast_ss(a + 0);
+            c00 = _mm256_fmadd_ps(av, b0, c00); c01 = _mm256_fmadd_ps(av, b1, c01);
+            av = _mm256_broadcast_ss(a + 1);
+            c10 = _mm256_fmadd_ps(av, b0, c10); c11 = _mm256_fmadd_ps(av, b1, c11);
+            av = _mm256_broadcast_ss(a + 2);
+            c20 = _mm256_fmadd_ps(av, b0, c20); c21 = _mm256_fmadd_ps(av, b1, c21);
+            av = _mm256_broadcast_ss(a + 3);
+            c30 = _mm256_fmadd_ps(av, b0, c30); c31 = _mm256_fmadd_ps(av, b1, c31);
+            av = _mm256_broadcast_ss(a + 4);
+            c40 = _mm256_fmadd_ps(av, b0, c40); c41 = _mm256_fmadd_ps(av, b1, c41);
+            av = _mm256_broadcast_ss(a + 5);
+            c50 = _mm256_fmadd_ps(av, b0, c50); c51 = _mm256_fmadd_ps(av, b1, c51);
+            a += 6;
+            b += 16;
+        }
+
+#define _GEMM_STORE_ROW(i)\
+        _mm256_storeu_ps(c + i * ldc,     _mm256_add_ps(_mm256_loadu_ps(c + i * ldc),     c##i##0));\
+        _mm256_storeu_ps(c + i * ldc + 8, _mm256_add_ps(_mm256_loadu_ps(c + i * ldc + 8), c##i##1));
+        _GEMM_STORE_ROW(0) _GEMM_STORE_ROW(1) _GEMM_STORE_ROW(2)
+        _GEMM_STORE_ROW(3) _GEMM_STORE_ROW(4) _GEMM_STORE_ROW(5)
+#undef _GEMM_STORE_ROW
+    }
+};
+
+template<>
+struct gemm_micro<double, SIMD_AVX2>{
+    _MAT_TARGET("avx2,fma")
+    static void run(size_t kc, const double* a, const double* b, double* c, size_t ldc){
+        __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+        __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+        __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+        __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+        __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+        __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+        for(size_t k = 0; k < kc; ++k){
+            __m256d b0 = _mm256_load_pd(b);
+            __m256d b1 = _mm256_load_pd(b + 4);
+            __m256d av;
+            av = _mm256_broadcast_sd(a + 0);
+            c00 = _mm256_fmadd_pd(av, b0, c00); c01 = _mm256_fmadd_pd(av, b1, c01);
+            av = _mm256_broadcast_sd(a + 1);
+            c10 = _mm256_fmadd_pd(av, b0, c10); c11 = _mm256_fmadd_pd(av, b1, c11);
+            av = _mm256_broadcast_sd(a + 2);
+            c20 = _mm256_fmadd_pd(av, b0, c20); c21 = _mm256_fmadd_pd(av, b1, c21);
+            av = _mm256_broadcast_sd(a + 3);
+            c30 = _mm256_fmadd_pd(av, b0, c30); c31 = _mm256_fmadd_pd(av, b1, c31);
+            av = _mm256_broadcast_sd(a + 4);
+            c40 = _mm256_fmadd_pd(av, b0, c40); c41 = _mm256_fmadd_pd(av, b1, c41);
+            av = _mm256_broadcast_sd(a + 5);
+            c50 = _mm256_fmadd_pd(av, b0, c50); c51 = _mm256_fmadd_pd(av, b1, c51);
+            a += 6;
+            b += 8;
+        }
+
+#define _GEMM_STORE_ROW(i)\
+        _mm256_storeu_pd(c + i * ldc,     _mm256_add_pd(_mm256_loadu_pd(c + i * ldc),     c##i##0));\
+        _mm256_storeu_pd(c + i * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + i * ldc + 4), c##i##1));
+        _GEMM_STORE_ROW(0) _GEMM_STORE_ROW(1) _GEMM_STORE_ROW(2)
+        _GEMM_STORE_ROW(3) _GEMM_STORE_ROW(4) _GEMM_STORE_ROW(5)
+#undef _GEMM_STORE_ROW
+    }
+};
+
+/*AVX-512: 12 rows of two zmm accumulators each, 24 of the 32 registers.*/
+template<>
+struct gemm_micro<float, SIMD_AVX512>{
+    _MAT_TARGET("avx512f")
+    static void run(size_t kc, const float* a, const float* b, float* c, size_t ldc){
+        constexpr size_t MR = 12;
+        __m512 acc[MR][2];
+        #pragma GCC unroll 12
+        for(size_t i = 0; i < MR; ++i)
+            acc[i][0] = acc[i][1] = _mm512_setzero_ps();
+
+        for(size_t k = 0; k < kc; ++k){
+            __m512 b0 = _mm512_load_ps(b);
+            __m512 b1 = _mm512_load_ps(b + 16);
+            #pragma GCC unroll 12
+            for(size_t i = 0; i < MR; ++i){
+                __m512 av = _mm512_set1_ps(a[i]);
+                acc[i][0] = _mm512_fmadd_ps(av, b0, acc[i][0]);
+                acc[i][1] = _mm512_fmadd_ps(av, b1, acc[i][1]);
+            }
+            a += MR;
+            b += 32;
+        }
+
+        #pragma GCC unroll 12
+        for(size_t i = 0; i < MR; ++i){
+            _mm512_storeu_ps(c + i * ldc,      _mm512_add_ps(_mm512_loadu_ps(c + i * ldc),      acc[i][0]));
+            _mm512_storeu_ps(c + i * ldc + 16, _mm512_add_ps(_mm512_loadu_ps(c + i * ldc + 16), acc[i][1]));
+        }
+    }
+};
+
+template<>
+struct gemm_micro<double, SIMD_AVX512>{
+    _MAT_TARGET("avx512f")
+    static void run(size_t kc, const double* a, const double* b, double* c, size_t ldc){
+        constexpr size_t MR = 12;
+        __m512d acc[MR][2];
+        #pragma GCC unroll 12
+        for(size_t i = 0; i < MR; ++i)
+            acc[i][0] = acc[i][1] = _mm512_setzero_pd();
+
+        for(size_t k = 0; k < kc; ++k){
+            __m512d b0 = _mm512_load_pd(b);
+            __m512d b1 = _mm512_load_pd(b + 8);
+            #pragma GCC unroll 12
+            for(size_t i = 0; i < MR; ++i){
+                __m512d av = _mm512_set1_pd(a[i]);
+                acc[i][0] = _mm512_fmadd_pd(av, b0, acc[i][0]);
+                acc[i][1] = _mm512_fmadd_pd(av, b1, acc[i][1]);
+            }
+            a += MR;
+            b += 16;
+        }
+
+        #pragma GCC unroll 12
+        for(size_t i = 0; i < MR; ++i){
+            _mm512_storeu_pd(c + i * ldc,     _mm512_add_pd(_mm512_loadu_pd(c + i * ldc),     acc[i][0]));
+            _mm512_storeu_pd(c + i * ldc + 8, _mm512_add_pd(_mm512_loadu_pd(c + i * ldc + 8), acc[i][1]));
+        }
+    }
+};
+
+#endif
+
+/*run the micro kernel on a (possibly partial, strided or 16-bit) mr x nr tile of C.*/
+template<SimdLevel _L, class _Ty, class _Tc>
+void gemm_tile(size_t mr, size_t nr, size_t kc, const _Ty* a, const _Ty* b, _Tc* c, size_t rs_c, size_t cs_c){
+    constexpr size_t MR = gemm_block<_Ty, _L>::MR;
+    constexpr size_t NR = gemm_block<_Ty, _L>::NR;
+    if constexpr(std::is_same_v<_Ty, _Tc>){
+        if(mr == MR && nr == NR && cs_c == 1){
+            gemm_micro<_Ty, _L>::run(kc, a, b, c, rs_c);
+            return;
+        }
+    }
+    alignas(GEMM_ALIGN) _Ty buf[MR * NR] = {};
+    gemm_micro<_Ty, _L>::run(kc, a, b, buf, NR);
+    for(size_t i = 0; i < mr; ++i)
+        for(size_t j = 0; j < nr; ++j)
+            c[i * rs_c + j * cs_c] += buf[i * NR + j];
+}
+
+/*C[0:mc, j0:j1] += packed A block * packed B panel, j0 is a multiple of NR.*/
+template<SimdLevel _L, class _Ty, class _Tc>
+void gemm_macro(size_t mc, size_t j0, size_t j1, size_t kc,
+                const _Ty* a_pack, const _Ty* b_pack, _Tc* c, size_t rs_c, size_t cs_c){
+    constexpr size_t MR = gemm_block<_Ty, _L>::MR;
+    constexpr size_t NR = gemm_block<_Ty, _L>::NR;
+    for(size_t jr = j0; jr < j1; jr += NR){
+        size_t nr = std::min(NR, j1 - jr);
+        for(size_t ir = 0; ir < mc; ir += MR){
+            size_t mr = std::min(MR, mc - ir);
+            gemm_tile<_L>(mr, nr, kc, a_pack + ir * kc, b_pack + jr * kc,
+                      c + ir * rs_c + jr * cs_c, rs_c, cs_c);
+        }
+    }
+}
+
+/*gemm with the blocking and micro kernel of level _L for the compute type of _Ty.*/
+template<SimdLevel _L, typename _Ty, typename _Tc>
+void gemm_driver(const _Ty *a, const _Ty *b, _Tc* dst,
+             const size_t M, const size_t K, const size_t N,
+             const size_t rs_a, const size_t cs_a,
+             const size_t rs_b, const size_t cs_b,
+             const size_t rs_c, const size_t cs_c){
+    using _Acc = compute_t<_Ty>;
+    using blk = gemm_block<_Acc, _L>;
+    constexpr size_t MR = blk::MR, NR = blk::NR;
+    constexpr size_t MC = blk::MC, KC = blk::KC, NC = blk::NC;
+
+    if(M == 0 || N == 0 || K == 0)
+        return;
+
+    thread_local gemm_scratch<_Acc> a_scratch, b_scratch;
+    _Acc* b_pack = b_scratch.get(KC * ((std::min(N, NC) + NR - 1) / NR * NR));
+
+    size_t nth = parallel_threads(M * K * N);
+
+    if(nth <= 1){
+        _Acc* a_pack = a_scratch.get(MC * KC);
+        for(size_t jc = 0; jc < N; jc += NC){
+            size_t nc = std::min(NC, N - jc);
+            for(size_t pc = 0; pc < K; pc += KC){
+                size_t kc = std::min(KC, K - pc);
+                gemm_pack_b<NR>(b + pc * rs_b + jc * cs_b, rs_b, cs_b, kc, nc, b_pack);
+
+                for(size_t ic = 0; ic < M; ic += MC){
+                    size_t mc = std::min(MC, M - ic);
+                    gemm_pack_a<MR>(a + ic * rs_a + pc * cs_a, rs_a, cs_a, mc, kc, a_pack);
+                    gemm_macro<_L>(mc, 0, nc, kc, a_pack, b_pack, dst + ic * rs_c + jc * cs_c, rs_c, cs_c);
+                }
+            }
+        }
+        return;
+    }
+
+    /*
+        B panel is packed cooperatively and shared, then the (ic, jr-chunk) grid
+        of the panel is split across threads. Columns are only split when there
+        are fewer row blocks than threads, so A is rarely packed twice.
+    */
+    const size_t m_blocks = (M + MC - 1) / MC;
+
+    #pragma omp parallel num_threads(nth)
+    {
+        _Acc* a_pack = a_scratch.get(MC * KC);
+        for(size_t jc = 0; jc < N; jc += NC){
+            size_t nc = std::min(NC, N - jc);
+            size_t slivers = (nc + NR - 1) / NR;
+            size_t n_split = std::min(slivers, (nth + m_blocks - 1) / m_blocks);
+            size_t chunk = (slivers + n_split - 1) / n_split * NR;
+
+            for(size_t pc = 0; pc < K; pc += KC){
+                size_t kc = std::min(KC, K - pc);
+
+                #pragma omp for schedule(static)
+                for(size_t jr = 0; jr < nc; jr += NR)
+                    gemm_pack_b<NR>(b + pc * rs_b + (jc + jr) * cs_b, rs_b, cs_b,
+                                kc, std::min(NR, nc - jr), b_pack + jr * kc);
+
+                size_t last_ic = (size_t)-1;
+                #pragma omp for schedule(dynamic)
+                for(size_t job = 0; job < m_blocks * n_split; ++job){
+                    size_t ic = job / n_split * MC;
+                    size_t j0 = job % n_split * chunk;
+                    if(j0 >= nc)
+                        continue;
+                    size_t mc = std::min(MC, M - ic);
+                    if(ic != last_ic){
+                        gemm_pack_a<MR>(a + ic * rs_a + pc * cs_a, rs_a, cs_a, mc, kc, a_pack);
+                        last_ic = ic;
+                    }
+                    gemm_macro<_L>(mc, j0, std::min(nc, j0 + chunk), kc, a_pack, b_pack,
+                               dst + ic * rs_c + jc * cs_c, rs_c, cs_c);
+                }
+            }
+        }
+    }
+}
+
+/*gemm_driver of the current simd_level().*/
+template<typename _Ty, typename _Tc>
+void gemm_dispatch(const _Ty *a, const _Ty *b, _Tc* dst,
+             const size_t M, const size_t K, const size_t N,
+             const size_t rs_a, const size_t cs_a,
+             const size_t rs_b, const size_t cs_b,
+             const size_t rs_c, const size_t cs_c){
+    switch(simd_level()){
+#ifdef _MAT_X86
+    case SIMD_AVX512:
+        gemm_driver<SIMD_AVX512>(a, b, dst, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+        break;
+    case SIMD_AVX2:
+        gemm_driver<SIMD_AVX2>(a, b, dst, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+        break;
+    case SIMD_SSE42:
+        gemm_driver<SIMD_SSE42>(a, b, dst, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+        break;
+#endif
+    default:
+        gemm_driver<SIMD_GENERIC>(a, b, dst, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+    }
+}
+
+/*
+    C += A * B with arbitrary (non-negative) row and column strides,
+    so transposed or ROI operands need no copy.
+*/
+template<typename _Ty>
+void gemm(const _Ty *a, const _Ty *b, _Ty* dst,
+             const size_t M, const size_t K, const size_t N,
+             const size_t rs_a, const size_t cs_a,
+             const size_t rs_b, const size_t cs_b,
+             const size_t rs_c, const size_t cs_c){
+    if constexpr(is_half_v<_Ty>){
+        /*C would be rounded to 16 bits after every KC panel, accumulate a float copy instead.*/
+        if(K > gemm_block<float, SIMD_GENERIC>::KC && M != 0 && N != 0){
+            std::unique_ptr<float[]> acc(new float[M * N]);
+            for(size_t i = 0; i < M; ++i)
+                for(size_t j = 0; j < N; ++j)
+                    acc[i * N + j] = dst[i * rs_c + j * cs_c];
+            gemm_dispatch(a, b, acc.get(), M, K, N, rs_a, cs_a, rs_b, cs_b, N, 1);
+            for(size_t i = 0; i < M; ++i){
+                if(cs_c == 1){
+                    simd::narrow(acc.get() + i * N, dst + i * rs_c, N);
+                    continue;
+                }
+                for(size_t j = 0; j < N; ++j)
+                    dst[i * rs_c + j * cs_c] = acc[i * N + j];
+            }
+            return;
+        }
+    }
+    gemm_dispatch(a, b, dst, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+}
+
+/*C += A * B, all matrices row-major with unit column stride.*/
+template<typename _Ty>
+void gemm(const _Ty *a, const _Ty *b, _Ty* dst,
+             const size_t M, const size_t K, const size_t N,
+             const size_t step_a, const size_t step_b, const size_t step_dst){
+    gemm(a, b, dst, M, K, N, step_a, 1, step_b, 1, step_dst, 1);
+}
+
+/*fewest rows of a band: B is packed again for every band of an entry.*/
+constexpr size_t GEMM_BATCH_ROWS = 32;
+
+/*
+    C[i] += A[i] * B[i] for i in [0, batch), the operands of entry i starting
+    i * bs_a, i * bs_b and i * bs_c elements past a, b and dst, so a zero batch
+    step broadcasts an operand. With at least as many entries as threads every
+    entry is a serial job handed out dynamically. Fewer entries that are each
+    worth threading run one after the other on all of them; small ones are cut
+    into bands of rows, so that every thread still has a job.
+*/
+template<typename _Ty>
+void gemm_batched(const size_t batch, const _Ty *a, const _Ty *b, _Ty* dst,
+             const size_t M, const size_t K, const size_t N,
+             const size_t bs_a, const size_t rs_a, const size_t cs_a,
+             const size_t bs_b, const size_t rs_b, const size_t cs_b,
+             const size_t bs_c, const size_t rs_c, const size_t cs_c){
+    size_t nth = parallel_threads(batch * M * K * N);
+    if(nth <= 1 || (batch < nth && parallel_threads(M * K * N) > 1)){
+        for(size_t i = 0; i < batch; ++i)
+            gemm(a + i * bs_a, b + i * bs_b, dst + i * bs_c, M, K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+        return;
+    }
+
+    size_t bands = batch >= nth? 1: std::min((nth + batch - 1) / batch, (M + GEMM_BATCH_ROWS - 1) / GEMM_BATCH_ROWS);
+    size_t rows = (M + bands - 1) / bands;
+
+    /*gemm inside the region sees omp_in_parallel() and stays serial.*/
+    #pragma omp parallel for num_threads(nth) schedule(dynamic)
+    for(size_t job = 0; job < batch * bands; ++job){
+        size_t i = job / bands, r = job % bands * rows;
+        if(r >= M)
+            continue;
+        gemm(a + i * bs_a + r * rs_a, b + i * bs_b, dst + i * bs_c + r * rs_c,
+             std::min(rows, M - r), K, N, rs_a, cs_a, rs_b, cs_b, rs_c, cs_c);
+    }
+}
+
+enum GemmTrans{
+    GEMM_NO_TRANS = 0, GEMM_TRANS = 1
+};
+
+/*
+    BLAS-style interface: C[M x N] += op(A) * op(B), where op(X) is X or X^T
+    and lda/ldb/ldc are the row pitches of the stored (row-major) matrices.
+*/
+template<typename _Ty>
+void gemm(GemmTrans trans_a, GemmTrans trans_b,
+             const size_t M, const size_t K, const size_t N,
+             const _Ty* a, const size_t lda, const _Ty* b, const size_t ldb,
+             _Ty* dst, const size_t ldc){
+    gemm(a, b, dst, M, K, N,
+         trans_a? 1: lda, trans_a? lda: 1,
+         trans_b? 1: ldb, trans_b? ldb: 1,
+         ldc, 1);
+}
+
+} // namespace internal
+
+} // namespace zmat
@@ -0,0 +1,198 @@
+#pragma once
+
+#include<bit>
+#include<limits>
+#include<stdint.h>
+#include<type_traits>
+#include "utils.h"
+
+#ifdef _MAT_X86
+#include<immintrin.h>
+#endif
+
+namespace zmat{
+
+namespace internal{
+
+/*
+    float <-> 16-bit float bit conversions, round to nearest even. They are
+    branch free, selects are and/or with compare masks (gcc turns ternaries
+    on these into branches), so the elementwise loops calling them vectorize.
+*/
+constexpr uint32_t select_bits(bool cond, uint32_t a, uint32_t b){
+    uint32_t m = -uint32_t(cond);
+    return (a & m) | (b & ~m);
+}
+
+constexpr uint16_t float_to_half_bits(float val){
+    uint32_t x = std::bit_cast<uint32_t>(val);
+    uint32_t sign = (x >> 16) & 0x8000u;
+    x &= 0x7fffffffu;
+    /*normal halves: rebias the exponent and round off 13 mantissa bits, carries may reach inf.*/
+    uint32_t normal = (x - (112u << 23) + 0xfffu + ((x >> 13) & 1u)) >> 13;
+    /*subnormal halves: adding 0.5f lines the mantissa up with 2^-24 and lets the fpu round.*/
+    uint32_t sub = std::bit_cast<uint32_t>(std::bit_cast<float>(x) + 0.5f) - 0x3f000000u;
+    int32_t xi = int32_t(x);
+    uint32_t res = select_bits(xi < 0x38800000, sub, normal);
+    res = select_bits(xi >= 0x47800000, 0x7c00u, res);
+    res = select_bits(xi > 0x7f800000, 0x7e00u, res);
+    return uint16_t(res | sign);
+}
+
+constexpr float half_bits_to_float(uint16_t bits){
+    uint32_t em = bits & 0x7fffu;
+    /*scaling by 2^112 rebiases normals and normalizes subnormals alike.*/
+    uint32_t x = std::bit_cast<uint32_t>(std::bit_cast<float>(em << 13) * 0x1p112f);
+    x |= select_bits(int32_t(em) >= 0x7c00, 0x7f800000u, 0u);
+    return std::bit_cast<float>(x | (uint32_t(bits & 0x8000u) << 16));
+}
+
+constexpr uint16_t float_to_bf16_bits(float val){
+    uint32_t x = std::bit_cast<uint32_t>(val);
+    uint32_t res = (x + 0x7fffu + ((x >> 16) & 1u)) >> 16;
+    return uint16_t(select_bits(int32_t(x & 0x7fffffffu) > 0x7f800000, (x >> 16) | 0x40u, res));
+}
+
+constexpr float bf16_bits_to_float(uint16_t bits){
+    return std::bit_cast<float>(uint32_t(bits) << 16);
+}
+
+} // namespace internal
+
+/*
+    16-bit floating point storage types: IEEE binary16 (float16) and the
+    truncated float32 layout (bfloat16). Values convert to float for any
+    arithmetic, so expressions, reductions and gemm over these matrices
+    compute and accumulate in fp32 and round only when the result is stored.
+*/
+#define _MAT_HALF_TYPE(name, to_bits, from_bits)\
+struct name{\
+    uint16_t bits;\
+\
+    name() = default;\
+    constexpr name(float val): bits(internal::to_bits(val)){}\
+\
+    /*stores straight to bits, a temporary struct copy would keep the loop from vectorizing.*/\
+    constexpr name& operator =(float val){\
+        bits = internal::to_bits(val);\
+        return *this;\
+    }\
+\
+    constexpr operator float() const{\
+        return internal::from_bits(bits);\
+    }\
+\
+    static constexpr name from_raw(uint16_t bits){\
+        name res{};\
+        res.bits = bits;\
+        return res;\
+    }\
+\
+    name& operator +=(float val){ return *this = float(*this) + val; }\
+    name& operator -=(float val){ return *this = float(*this) - val; }\
+    name& operator *=(float val){ return *this = float(*this) * val; }\
+    name& operator /=(float val){ return *this = float(*this) / val; }\
+};
+
+_MAT_HALF_TYPE(float16, float_to_half_bits, half_bits_to_float)
+_MAT_HALF_TYPE(bfloat16, float_to_bf16_bits, bf16_bits_to_float)
+
+#undef _MAT_HALF_TYPE
+
+namespace internal{
+
+template<class _Ty>
+constexpr bool is_half_v = std::is_same_v<_Ty, float16> || std::is_same_v<_Ty, bfloat16>;
+
+/*type arithmetic on _Ty is carried out in: float for the 16-bit floats, _Ty itself otherwise.*/
+template<class _Ty>
+using compute_t = std::conditional_t<is_half_v<_Ty>, float, _Ty>;
+
+} // namespace internal
+
+namespace simd{
+
+#ifdef _MAT_X86
+
+_MAT_TARGET("f16c,avx")
+inline void widen_f16c(const float16* src, float* dst, size_t n){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    for(; i < n; ++i)
+        dst[i] = src[i];
+}
+
+_MAT_TARGET("f16c,avx")
+inline void narrow_f16c(const float* src, float16* dst, size_t n){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    for(; i < n; ++i)
+        dst[i] = src[i];
+}
+
+#endif
+
+/*
+    dst[i] = src[i] between a 16-bit float type and float for i in [0, n).
+    float16 goes through F16C from SIMD_AVX2 on (every AVX2 cpu has it),
+    bfloat16 is a shift either way.
+*/
+template<class _H>
+void widen(const _H* src, float* dst, size_t n){
+#ifdef _MAT_X86
+    if constexpr(std::is_same_v<_H, float16>){
+        if(internal::simd_level() >= SIMD_AVX2)
+            return widen_f16c(src, dst, n);
+    }
+#endif
+    #pragma omp simd
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = src[i];
+}
+
+template<class _H>
+void narrow(const float* src, _H* dst, size_t n){
+#ifdef _MAT_X86
+    if constexpr(std::is_same_v<_H, float16>){
+        if(internal::simd_level() >= SIMD_AVX2)
+            return narrow_f16c(src, dst, n);
+    }
+#endif
+    #pragma omp simd
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = src[i];
+}
+
+} // namespace simd
+
+} // namespace zmat
+
+#define _MAT_HALF_LIMITS(type, digits_, max_exp_, min_exp_, min_, max_, eps_, inf_, nan_)\
+template<>\
+class std::numeric_limits<type>{\
+public:\
+    static constexpr bool is_specialized = true;\
+    static constexpr bool is_signed = true;\
+    static constexpr bool is_integer = false;\
+    static constexpr bool is_exact = false;\
+    static constexpr bool has_infinity = true;\
+    static constexpr bool has_quiet_NaN = true;\
+    static constexpr int digits = digits_;\
+    static constexpr int radix = 2;\
+    static constexpr int max_exponent = max_exp_;\
+    static constexpr int min_exponent = min_exp_;\
+    static constexpr type min() noexcept{ return type::from_raw(min_); }\
+    static constexpr type max() noexcept{ return type::from_raw(max_); }\
+    static constexpr type lowest() noexcept{ return type::from_raw(max_ | 0x8000u); }\
+    static constexpr type epsilon() noexcept{ return type::from_raw(eps_); }\
+    static constexpr type infinity() noexcept{ return type::from_raw(inf_); }\
+    static constexpr type quiet_NaN() noexcept{ return type::from_raw(nan_); }\
+};
+
+_MAT_HALF_LIMITS(zmat::float16, 11, 16, -13, 0x0400u, 0x7bffu, 0x1400u, 0x7c00u, 0x7e00u)
+_MAT_HALF_LIMITS(zmat::bfloat16, 8, 128, -125, 0x0080u, 0x7f7fu, 0x3c00u, 0x7f80u, 0x7fc0u)
+
+#undef _MAT_HALF_LIMITS
@@ -127,28 +127,28 @@ public:
         return *(*this + diff);
     }
 
-    self operator++(){
+    self& operator++(){
+        move_ptr(1);
+        return *this;
+    }
+
+    self operator++(int){
         self res(*this);
         move_ptr(1);
         return res;
     }
 
-    self& operator++(int){
-        move_ptr(1);
+    self& operator--(){
+        move_ptr(-1);
         return *this;
     }
 
-    self operator--(){
+    self operator--(int){
         self res(*this);
         move_ptr(-1);
         return res;
     }
 
-    self& operator--(int){
-        move_ptr(-1);
-        return *this;
-    }
-
     self operator +(ptrdiff_t idx) const{
         self res(*this);
         res.move_ptr(idx);
@@ -185,27 +185,27 @@ public:
     }
 
     bool operator<(const self& it) const{
-        return _ptr < it._ptr;
+        return idx < it.idx;
     }
 
     bool operator<=(const self& it) const{
-        return _ptr <= it._ptr;
+        return idx <= it.idx;
     }
 
     bool operator>(const self& it) const{
-        return _ptr > it._ptr;
+        return idx > it.idx;
     }
 
     bool operator>=(const self& it) const{
-        return _ptr >= it._ptr;
+        return idx >= it.idx;
     }
 
     bool operator==(const self& it) const{
-        return _ptr == it._ptr;
+        return idx == it.idx;
     }
 
     bool operator!=(const self& it) const{
-        return _ptr != it._ptr;
+        return idx != it.idx;
     }
 };
 
@@ -0,0 +1,490 @@
+#pragma once
+
+#include<cstddef>
+#include<cstring>
+#include<stdint.h>
+#include<algorithm>
+#include<vector>
+#include<type_traits>
+#include "utils.h"
+#include "gemm.h"
+
+#ifdef _MAT_X86
+#include<immintrin.h>
+#endif
+
+namespace zmat{
+
+namespace internal{
+
+/*
+    8-bit quantized GEMM with int32 accumulation.
+
+    C[i][j] = sum_k (A[i][k] - za[i]) * (B[k][j] - zb[j])
+
+    A is packed as unsigned and B as signed bytes. An int8 A or a uint8 B is
+    flipped by 128 on the way (x ^ 0x80) and its zero point moved along, so
+    one u8 x s8 micro kernel serves all four type pairs. Slivers keep groups
+    of four consecutive k together, the layout vpmaddubsw + vpmaddwd and
+    vpdpbusd reduce in one step:
+      A sliver: per k/4, MR rows x 4 bytes
+      B sliver: per k/4, NR columns x 4 bytes
+    K is padded to a multiple of 4 with zeros but not blocked, so each tile
+    leaves the micro kernel with its final sums. The zero point terms come
+    from the row sums of A and column sums of B taken while packing, then
+    the tile goes straight to the epilogue.
+
+    Micro kernels per level:
+      SIMD_AVX512  vpdpbusd (AVX-512 VNNI), the AVX2 ones on cpus without it
+      SIMD_AVX2    vpmaddubsw + vpmaddwd on slivers where the int16 pair sums
+                   cannot saturate, B widened to int16 + vpmaddwd elsewhere
+      below        B widened to int16 + pmaddwd (SSE2)
+*/
+
+template<SimdLevel _L>
+struct qgemm_block{
+    static constexpr size_t MR = 4;
+    static constexpr size_t NR = 16;
+    static constexpr size_t MC = 128;
+};
+
+template<>
+struct qgemm_block<SIMD_AVX512>{
+    static constexpr size_t MR = 8;
+    static constexpr size_t NR = 32;
+    static constexpr size_t MC = 128;
+};
+
+/*bytes of a packed B panel, which spans all of K.*/
+constexpr size_t QGEMM_PANEL_BYTES = size_t(1) << 20;
+
+/*what packing xors into A (to unsigned) and B (to signed) values.*/
+template<class _Ty>
+constexpr uint8_t qgemm_flip_a = std::is_signed_v<_Ty>? 0x80: 0;
+
+template<class _Ty>
+constexpr uint8_t qgemm_flip_b = std::is_signed_v<_Ty>? 0: 0x80;
+
+/*pack A[mc x K] into MR-row slivers of u8, row_sum[i] = sum of row i as packed.*/
+template<size_t MR, class _Ta>
+void qgemm_pack_a(const _Ta* a, size_t rs, size_t cs, size_t mc, size_t K, uint8_t* dst, int32_t* row_sum){
+    constexpr uint8_t flip = qgemm_flip_a<_Ta>;
+    size_t kp = (K + 3) / 4 * 4;
+    for(size_t ir = 0; ir < mc; ir += MR){
+        size_t mr = std::min(MR, mc - ir);
+        for(size_t i = 0; i < MR; ++i){
+            uint8_t* out = dst + i * 4;
+            size_t k = 0;
+            if(i < mr){
+                const _Ta* src = a + (ir + i) * rs;
+                int32_t sum = 0;
+                if(cs == 1){
+                    /*whole groups of four are one word each.*/
+                    for(; k + 4 <= K; k += 4){
+                        uint32_t quad;
+                        std::memcpy(&quad, src + k, 4);
+                        quad ^= flip * 0x01010101u;
+                        std::memcpy(out + k * MR, &quad, 4);
+                    }
+                    #pragma omp simd reduction(+: sum)
+                    for(size_t t = 0; t < K; ++t)
+                        sum += uint8_t(uint8_t(src[t]) ^ flip);
+                }else{
+                    for(size_t t = 0; t < K; ++t)
+                        sum += uint8_t(uint8_t(src[t * cs]) ^ flip);
+                }
+                for(; k < K; ++k)
+                    out[k / 4 * MR * 4 + k % 4] = uint8_t(src[k * cs]) ^ flip;
+                row_sum[ir + i] = sum;
+            }
+            for(; k < kp; ++k)
+                out[k / 4 * MR * 4 + k % 4] = 0;
+        }
+        dst += MR * kp;
+    }
+}
+
+/*
+    pack B[K x nc] into NR-column slivers of s8, col_sum[j] = sum of column j
+    as packed. narrow[s] tells whether sliver s stays within [-64, 64], where
+    the pairwise int16 sums of vpmaddubsw cannot saturate.
+*/
+template<size_t NR, class _Tb>
+void qgemm_pack_b(const _Tb* b, size_t rs, size_t cs, size_t K, size_t nc, int8_t* dst, int32_t* col_sum, char* narrow){
+    constexpr uint8_t flip = qgemm_flip_b<_Tb>;
+    size_t kp = (K + 3) / 4 * 4;
+    for(size_t jr = 0; jr < nc; jr += NR){
+        size_t nr = std::min(NR, nc - jr);
+        int32_t sum[NR] = {};
+        uint32_t wide = 0;
+        size_t k = 0;
+        if(nr == NR && cs == 1){
+            /*four rows interleaved at a time, which vectorizes as a byte transpose.*/
+            for(; k + 4 <= K; k += 4){
+                int8_t* out = dst + k * NR;
+                const _Tb* src = b + k * rs + jr;
+                #pragma omp simd reduction(|: wide)
+                for(size_t j = 0; j < NR; ++j){
+                    int8_t v0 = int8_t(uint8_t(src[j]) ^ flip), v1 = int8_t(uint8_t(src[rs + j]) ^ flip);
+                    int8_t v2 = int8_t(uint8_t(src[2 * rs + j]) ^ flip), v3 = int8_t(uint8_t(src[3 * rs + j]) ^ flip);
+                    out[j * 4] = v0;
+                    out[j * 4 + 1] = v1;
+                    out[j * 4 + 2] = v2;
+                    out[j * 4 + 3] = v3;
+                    sum[j] += v0 + v1 + v2 + v3;
+                    wide |= uint32_t(v0 + 64) > 128 || uint32_t(v1 + 64) > 128
+                         || uint32_t(v2 + 64) > 128 || uint32_t(v3 + 64) > 128;
+                }
+            }
+        }
+        for(; k < kp; ++k){
+            int8_t* out = dst + k / 4 * NR * 4 + k % 4;
+            const _Tb* src = b + k * rs + jr * cs;
+            size_t j = 0;
+            for(; j < nr && k < K; ++j){
+                int8_t v = int8_t(uint8_t(src[j * cs]) ^ flip);
+                out[j * 4] = v;
+                sum[j] += v;
+                wide |= uint32_t(v + 64) > 128;
+            }
+            for(; j < NR; ++j)
+                out[j * 4] = 0;
+        }
+        for(size_t j = 0; j < nr; ++j)
+            col_sum[jr + j] = sum[j];
+        narrow[jr / NR] = !wide;
+        dst += NR * kp;
+    }
+}
+
+/*C[MR x NR] = Ap * Bp, portable version.*/
+template<size_t MR, size_t NR>
+inline void qgemm_micro_portable(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c){
+    int32_t acc[MR][NR] = {};
+    for(size_t k = 0; k < kp; k += 4){
+        for(size_t i = 0; i < MR; ++i)
+            for(size_t t = 0; t < 4; ++t){
+                int32_t av = a[i * 4 + t];
+                #pragma omp simd
+                for(size_t j = 0; j < NR; ++j)
+                    acc[i][j] += av * b[j * 4 + t];
+            }
+        a += MR * 4;
+        b += NR * 4;
+    }
+    std::memcpy(c, acc, sizeof(acc));
+}
+
+#ifdef __SSE2__
+
+/*
+    4 x 16 tile, 4 columns at a time: B widened to int16 by unpacking and
+    A rows broadcast as 4 int16, so pmaddwd leaves half of a group of four
+    k per dword. The halves are summed at the end. SSE2 is all it takes, int
+    multiplies left to the compiler would be pmulld or worse.
+*/
+inline void qgemm_micro_sse2(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c){
+    constexpr size_t MR = 4, NR = 16;
+    const __m128i zero = _mm_setzero_si128();
+    for(size_t g = 0; g < NR / 4; ++g){
+        __m128i lo[MR], hi[MR];
+        for(size_t i = 0; i < MR; ++i)
+            lo[i] = hi[i] = _mm_setzero_si128();
+
+        const uint8_t* ap = a;
+        const int8_t* bp = b + g * 16;
+        for(size_t k = 0; k < kp; k += 4){
+            __m128i bb = _mm_load_si128(reinterpret_cast<const __m128i*>(bp));
+            __m128i bl = _mm_srai_epi16(_mm_unpacklo_epi8(bb, bb), 8);
+            __m128i bh = _mm_srai_epi16(_mm_unpackhi_epi8(bb, bb), 8);
+            __m128i aa = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ap));
+            __m128i a01 = _mm_unpacklo_epi8(aa, zero), a23 = _mm_unpackhi_epi8(aa, zero);
+            __m128i av;
+#define _QGEMM_ROW(i, src, imm)\
+            av = _mm_shuffle_epi32(src, imm);\
+            lo[i] = _mm_add_epi32(lo[i], _mm_madd_epi16(av, bl));\
+            hi[i] = _mm_add_epi32(hi[i], _mm_madd_epi16(av, bh));
+            _QGEMM_ROW(0, a01, 0x44) _QGEMM_ROW(1, a01, 0xee) _QGEMM_ROW(2, a23, 0x44) _QGEMM_ROW(3, a23, 0xee)
+#undef _QGEMM_ROW
+            ap += MR * 4;
+            bp += NR * 4;
+        }
+
+        for(size_t i = 0; i < MR; ++i){
+            __m128 l = _mm_castsi128_ps(lo[i]), h = _mm_castsi128_ps(hi[i]);
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(l, h, 0x88));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(l, h, 0xdd));
+            _mm_store_si128(reinterpret_cast<__m128i*>(c + i * NR + g * 4), _mm_add_epi32(even, odd));
+        }
+    }
+}
+
+#endif
+
+#ifdef _MAT_X86
+
+/*
+    vpmaddubsw multiplies u8 x s8 and adds adjacent pairs into saturating
+    int16, vpmaddwd by ones then adds those pairs into int32: one dword per
+    column and group of four k. Only exact on narrow slivers.
+*/
+_MAT_TARGET("avx2")
+inline void qgemm_micro_avx2_narrow(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c){
+    constexpr size_t MR = 4;
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc[MR][2];
+    #pragma GCC unroll 4
+    for(size_t i = 0; i < MR; ++i)
+        acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+
+    for(size_t k = 0; k < kp; k += 4){
+        __m256i b0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(b));
+        __m256i b1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(b + 32));
+        #pragma GCC unroll 4
+        for(size_t i = 0; i < MR; ++i){
+            int32_t quad;
+            std::memcpy(&quad, a + i * 4, 4);
+            __m256i av = _mm256_set1_epi32(quad);
+            acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(_mm256_maddubs_epi16(av, b0), ones));
+            acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(_mm256_maddubs_epi16(av, b1), ones));
+        }
+        a += MR * 4;
+        b += 64;
+    }
+
+    #pragma GCC unroll 4
+    for(size_t i = 0; i < MR; ++i){
+        _mm256_store_si256(reinterpret_cast<__m256i*>(c + i * 16), acc[i][0]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(c + i * 16 + 8), acc[i][1]);
+    }
+}
+
+/*exact version for any sliver, qgemm_micro_sse2 on 8 columns at a time.*/
+_MAT_TARGET("avx2")
+inline void qgemm_micro_avx2_wide(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c){
+    constexpr size_t MR = 4;
+    for(size_t h = 0; h < 2; ++h){
+        __m256i lo[MR], hi[MR];
+        #pragma GCC unroll 4
+        for(size_t i = 0; i < MR; ++i)
+            lo[i] = hi[i] = _mm256_setzero_si256();
+
+        const uint8_t* ap = a;
+        const int8_t* bp = b + h * 32;
+        for(size_t k = 0; k < kp; k += 4){
+            __m256i bb = _mm256_load_si256(reinterpret_cast<const __m256i*>(bp));
+            __m256i bl = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(bb));
+            __m256i bh = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(bb, 1));
+            __m256i aw = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ap)));
+            __m256i av;
+#define _QGEMM_ROW(i, imm)\
+            av = _mm256_permute4x64_epi64(aw, imm);\
+            lo[i] = _mm256_add_epi32(lo[i], _mm256_madd_epi16(av, bl));\
+            hi[i] = _mm256_add_epi32(hi[i], _mm256_madd_epi16(av, bh));
+            _QGEMM_ROW(0, 0x00) _QGEMM_ROW(1, 0x55) _QGEMM_ROW(2, 0xaa) _QGEMM_ROW(3, 0xff)
+#undef _QGEMM_ROW
+            ap += MR * 4;
+            bp += 64;
+        }
+
+        /*lane-wise hadd leaves columns 0 1 4 5 | 2 3 6 7, the permute puts them in order.*/
+        #pragma GCC unroll 4
+        for(size_t i = 0; i < MR; ++i){
+            __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo[i], hi[i]), 0xd8);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(c + i * 16 + h * 8), sum);
+        }
+    }
+}
+
+/*vpdpbusd does four u8 x s8 products and their sum into an int32 in one go, without saturation.*/
+_MAT_TARGET("avx512f,avx512vnni")
+inline void qgemm_micro_vnni(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c){
+    constexpr size_t MR = 8;
+    __m512i acc[MR][2];
+    #pragma GCC unroll 8
+    for(size_t i = 0; i < MR; ++i)
+        acc[i][0] = acc[i][1] = _mm512_setzero_si512();
+
+    for(size_t k = 0; k < kp; k += 4){
+        __m512i b0 = _mm512_load_si512(b);
+        __m512i b1 = _mm512_load_si512(b + 64);
+        #pragma GCC unroll 8
+        for(size_t i = 0; i < MR; ++i){
+            int32_t quad;
+            std::memcpy(&quad, a + i * 4, 4);
+            __m512i av = _mm512_set1_epi32(quad);
+            acc[i][0] = _mm512_dpbusd_epi32(acc[i][0], av, b0);
+            acc[i][1] = _mm512_dpbusd_epi32(acc[i][1], av, b1);
+        }
+        a += MR * 4;
+        b += 128;
+    }
+
+    #pragma GCC unroll 8
+    for(size_t i = 0; i < MR; ++i){
+        _mm512_store_si512(c + i * 32, acc[i][0]);
+        _mm512_store_si512(c + i * 32 + 16, acc[i][1]);
+    }
+}
+
+#endif
+
+template<SimdLevel _L>
+struct qgemm_micro{
+    static void run(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c, bool){
+#ifdef __SSE2__
+        qgemm_micro_sse2(kp, a, b, c);
+#else
+        qgemm_micro_portable<qgemm_block<_L>::MR, qgemm_block<_L>::NR>(kp, a, b, c);
+#endif
+    }
+};
+
+#ifdef _MAT_X86
+
+template<>
+struct qgemm_micro<SIMD_AVX2>{
+    static void run(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c, bool narrow){
+        if(narrow)
+            qgemm_micro_avx2_narrow(kp, a, b, c);
+        else
+            qgemm_micro_avx2_wide(kp, a, b, c);
+    }
+};
+
+template<>
+struct qgemm_micro<SIMD_AVX512>{
+    static void run(size_t kp, const uint8_t* a, const int8_t* b, int32_t* c, bool){
+        qgemm_micro_vnni(kp, a, b, c);
+    }
+};
+
+#endif
+
+/*
+    qgemm with the blocking and micro kernel of level _L. ep(i, j, mr, nr,
+    tile, ld) gets every finished mr x nr tile of C at (i, j), already zero
+    point corrected.
+*/
+template<SimdLevel _L, class _Ta, class _Tb, class _Ep>
+void qgemm_driver(const _Ta* a, const _Tb* b, const size_t M, const size_t K, const size_t N,
+                  const size_t rs_a, const size_t cs_a, const size_t rs_b, const size_t cs_b,
+                  const int32_t* za, const int32_t* zb, _Ep& ep){
+    using blk = qgemm_block<_L>;
+    constexpr size_t MR = blk::MR, NR = blk::NR, MC = blk::MC;
+    if(M == 0 || N == 0 || K == 0)
+        return;
+
+    size_t kp = (K + 3) / 4 * 4;
+    size_t NC = std::max(NR, QGEMM_PANEL_BYTES / kp / NR * NR);
+    size_t nc_max = std::min(N, NC);
+
+    thread_local gemm_scratch<uint8_t> a_scratch;
+    thread_local gemm_scratch<int8_t> b_scratch;
+    int8_t* b_pack = b_scratch.get(kp * ((nc_max + NR - 1) / NR * NR));
+    std::vector<int32_t> b_sum(nc_max);
+    std::vector<char> narrow((nc_max + NR - 1) / NR);
+
+    /*
+        zero points of the packed values: zb moves with B when it is flipped,
+        and the per column part of the correction is folded once per panel.
+        The arithmetic is modulo 2^32, exact whenever the result fits int32.
+    */
+    const uint32_t flip_a = qgemm_flip_a<_Ta>, flip_b = qgemm_flip_b<_Tb>;
+    std::vector<uint32_t> zb_p(nc_max), col_term(nc_max);
+
+    size_t nth = parallel_threads(M * K * N);
+    const size_t m_blocks = (M + MC - 1) / MC;
+
+    #pragma omp parallel num_threads(nth) if(nth > 1)
+    {
+        uint8_t* a_pack = a_scratch.get(MC * kp);
+        uint32_t a_sum[MC], za_p[MC];
+        alignas(GEMM_ALIGN) int32_t tile[MR * NR];
+
+        for(size_t jc = 0; jc < N; jc += NC){
+            size_t nc = std::min(NC, N - jc);
+            size_t slivers = (nc + NR - 1) / NR;
+            size_t n_split = std::min(slivers, (nth + m_blocks - 1) / m_blocks);
+            size_t chunk = (slivers + n_split - 1) / n_split * NR;
+
+            #pragma omp for schedule(static)
+            for(size_t jr = 0; jr < nc; jr += NR){
+                size_t nr = std::min(NR, nc - jr);
+                qgemm_pack_b<NR>(b + (jc + jr) * cs_b, rs_b, cs_b, K, nr, b_pack + jr * kp,
+                                 b_sum.data() + jr, narrow.data() + jr / NR);
+                for(size_t j = jr; j < jr + nr; ++j){
+                    zb_p[j] = uint32_t(zb[jc + j]) - flip_b;
+                    col_term[j] = uint32_t(b_sum[j]) - uint32_t(K) * zb_p[j];
+                }
+            }
+
+            size_t last_ic = (size_t)-1;
+            #pragma omp for schedule(dynamic)
+            for(size_t job = 0; job < m_blocks * n_split; ++job){
+                size_t ic = job / n_split * MC;
+                size_t j0 = job % n_split * chunk, j1 = std::min(nc, j0 + chunk);
+                if(j0 >= nc)
+                    continue;
+                size_t mc = std::min(MC, M - ic);
+                if(ic != last_ic){
+                    int32_t sums[MC];
+                    qgemm_pack_a<MR>(a + ic * rs_a, rs_a, cs_a, mc, K, a_pack, sums);
+                    for(size_t i = 0; i < mc; ++i){
+                        a_sum[i] = uint32_t(sums[i]);
+                        za_p[i] = uint32_t(za[ic + i]) + flip_a;
+                    }
+                    last_ic = ic;
+                }
+
+                for(size_t jr = j0; jr < j1; jr += NR){
+                    size_t nr = std::min(NR, j1 - jr);
+                    for(size_t ir = 0; ir < mc; ir += MR){
+                        size_t mr = std::min(MR, mc - ir);
+                        qgemm_micro<_L>::run(kp, a_pack + ir * kp, b_pack + jr * kp, tile, narrow[jr / NR]);
+                        for(size_t i = 0; i < mr; ++i){
+                            uint32_t as = a_sum[ir + i], az = za_p[ir + i];
+                            int32_t* row = tile + i * NR;
+                            #pragma omp simd
+                            for(size_t j = 0; j < nr; ++j)
+                                row[j] = int32_t(uint32_t(row[j]) - zb_p[jr + j] * as - az * col_term[jr + j]);
+                        }
+                        ep(ic + ir, jc + jr, mr, nr, tile, NR);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+    C = (A - za) * (B - zb) over 8-bit operands with arbitrary strides,
+    za holds M zero points and zb N. The int32 result reaches ep tile by
+    tile, see qgemm_driver.
+*/
+template<class _Ta, class _Tb, class _Ep>
+void qgemm(const _Ta* a, const _Tb* b, const size_t M, const size_t K, const size_t N,
+           const size_t rs_a, const size_t cs_a, const size_t rs_b, const size_t cs_b,
+           const int32_t* za, const int32_t* zb, _Ep&& ep){
+    static_assert(sizeof(_Ta) == 1 && sizeof(_Tb) == 1 && std::is_integral_v<_Ta> && std::is_integral_v<_Tb>,
+                  "qgemm operands are 8-bit integers");
+    switch(simd_level()){
+#ifdef _MAT_X86
+    case SIMD_AVX512:
+        if(cpu_has_vnni()){
+            qgemm_driver<SIMD_AVX512>(a, b, M, K, N, rs_a, cs_a, rs_b, cs_b, za, zb, ep);
+            break;
+        }
+        [[fallthrough]];
+    case SIMD_AVX2:
+        qgemm_driver<SIMD_AVX2>(a, b, M, K, N, rs_a, cs_a, rs_b, cs_b, za, zb, ep);
+        break;
+#endif
+    default:
+        qgemm_driver<SIMD_GENERIC>(a, b, M, K, N, rs_a, cs_a, rs_b, cs_b, za, zb, ep);
+    }
+}
+
+} // namespace internal
+
+} // namespace zmat
@@ -1,7 +1,14 @@
 #pragma once
 #include"iter.h"
+#include"half.h"
 #include<stdint.h>
+#include<cmath>
+#include<limits>
+#include<utility>
 #include<type_traits>
+#ifdef _MAT_X86
+#include<immintrin.h>
+#endif
 
 namespace zmat{
 namespace simd{
@@ -69,5 +76,360 @@ void vec_div(const _Ty* a, const _Ty* b, _Ty* dst, size_t size){
         dst[i] = a[i] / b[i];
 }
 
+/*alignment the kernels below check for before using aligned vector accesses.*/
+constexpr size_t SIMD_ALIGN = 32;
+
+inline bool is_aligned(const void* ptr){
+    return reinterpret_cast<uintptr_t>(ptr) % SIMD_ALIGN == 0;
+}
+
+#ifdef _MAT_X86
+/*flatten: fn is called from several copies of the loop, which keeps the inliner's size limits from leaving a call per element.*/
+template<class _Fn>
+_MAT_TARGET("avx2,fma") __attribute__((flatten))
+void simd_for_avx2(size_t n, _Fn fn){
+    #pragma omp simd
+    for(size_t i = 0; i < n; ++i)
+        fn(i);
+}
+
+template<class _Fn>
+_MAT_TARGET("sse4.2") __attribute__((flatten))
+void simd_for_sse42(size_t n, _Fn fn){
+    #pragma omp simd
+    for(size_t i = 0; i < n; ++i)
+        fn(i);
+}
+#endif
+
+/*
+    fn(i) for i in [0, n) as one omp simd loop. Loops bound by element
+    conversions rather than by memory (16-bit floats, rounding and
+    saturating casts) pass _Convert, they run an AVX2 or SSE4.2 build of
+    the loop (blends and roundps) when simd_level() allows.
+*/
+template<bool _Convert, class _Fn>
+void simd_for(size_t n, _Fn fn){
+#ifdef _MAT_X86
+    if constexpr(_Convert){
+        if(internal::simd_level() >= SIMD_AVX2)
+            return simd_for_avx2(n, fn);
+        if(internal::simd_level() >= SIMD_SSE42)
+            return simd_for_sse42(n, fn);
+    }
+#endif
+    #pragma omp simd
+    for(size_t i = 0; i < n; ++i)
+        fn(i);
+}
+
+/*
+    In-place update kernels, dst[i] op= src[i] or dst[i] op= val.
+    The strided forms take element steps and fall back to the
+    contiguous loop when both steps are 1.
+*/
+#define _SIMD_INPLACE_KERNEL(name, op)\
+struct name{\
+    template<typename _Ty, typename _T>\
+    static constexpr bool half = internal::is_half_v<_Ty> || internal::is_half_v<_T>;\
+\
+    template<typename _Ty, typename _T>\
+    static void apply(_Ty* dst, const _T* src, size_t size){\
+        if constexpr(half<_Ty, _T>){\
+            simd_for<true>(size, [=](size_t i){ dst[i] op src[i]; });\
+        }else if(is_aligned(dst) && is_aligned(src)){\
+            _Pragma("omp simd aligned(dst, src: 32)")\
+            for(size_t i = 0; i < size; ++i)\
+                dst[i] op src[i];\
+        }else{\
+            _Pragma("omp simd")\
+            for(size_t i = 0; i < size; ++i)\
+                dst[i] op src[i];\
+        }\
+    }\
+    template<typename _Ty, typename _T>\
+    static void apply_scalar(_Ty* dst, const _T& val, size_t size){\
+        if constexpr(half<_Ty, _T>){\
+            simd_for<true>(size, [=](size_t i){ dst[i] op val; });\
+        }else if(is_aligned(dst)){\
+            _Pragma("omp simd aligned(dst: 32)")\
+            for(size_t i = 0; i < size; ++i)\
+                dst[i] op val;\
+        }else{\
+            _Pragma("omp simd")\
+            for(size_t i = 0; i < size; ++i)\
+                dst[i] op val;\
+        }\
+    }\
+    template<typename _Ty, typename _T>\
+    static void apply(_Ty* dst, size_t dst_step, const _T* src, size_t src_step, size_t size){\
+        if(dst_step == 1 && src_step == 1)\
+            return apply(dst, src, size);\
+        _Pragma("omp simd")\
+        for(size_t i = 0; i < size; ++i)\
+            dst[i * dst_step] op src[i * src_step];\
+    }\
+    template<typename _Ty, typename _T>\
+    static void apply_scalar(_Ty* dst, size_t dst_step, const _T& val, size_t size){\
+        if(dst_step == 1)\
+            return apply_scalar(dst, val, size);\
+        _Pragma("omp simd")\
+        for(size_t i = 0; i < size; ++i)\
+            dst[i * dst_step] op val;\
+    }\
+};
+
+_SIMD_INPLACE_KERNEL(add_to, +=)
+_SIMD_INPLACE_KERNEL(sub_from, -=)
+_SIMD_INPLACE_KERNEL(mul_by, *=)
+_SIMD_INPLACE_KERNEL(div_by, /=)
+
+#undef _SIMD_INPLACE_KERNEL
+
+/*
+    range of _U as values of _T, for the saturating casts that can go out of
+    range: floating or integral to integral, and floating to a narrower floating.
+    When _T is floating and _U integral the upper bound is the largest _T not
+    above max(_U), e.g. 2147483520.f for int32, so cast_to sends anything past
+    it to max(_U) itself.
+*/
+template<class _T, class _U>
+constexpr _T cast_upper(){
+    constexpr auto mx = std::numeric_limits<_U>::max();
+    if constexpr(std::is_floating_point_v<_U>){
+        return _T(mx);
+    }else if constexpr(std::is_floating_point_v<_T>){
+        constexpr int bits = std::numeric_limits<_U>::digits, keep = std::numeric_limits<_T>::digits;
+        if constexpr(bits > keep)
+            return _T((mx >> (bits - keep)) << (bits - keep));
+        else
+            return _T(mx);
+    }else{
+        return std::cmp_greater(mx, std::numeric_limits<_T>::max())? std::numeric_limits<_T>::max(): _T(mx);
+    }
+}
+
+template<class _T, class _U>
+constexpr _T cast_lower(){
+    constexpr auto mn = std::numeric_limits<_U>::lowest();
+    if constexpr(std::is_integral_v<_T>)
+        return std::cmp_less(mn, std::numeric_limits<_T>::lowest())? std::numeric_limits<_T>::lowest(): _T(mn);
+    else
+        return _T(mn);
+}
+
+/*
+    Element conversion to _U. With _Round, floating values going to an
+    integral type are rounded to nearest (ties to even) instead of
+    truncated. With _Saturate, values are clamped to the range of _U and
+    NaN becomes 0, instead of leaving out-of-range values to the cast.
+    16-bit floats are converted as floats.
+    Written with plain selects so the loops calling it vectorize.
+*/
+template<class _U, bool _Round, bool _Saturate>
+struct cast_to{
+    template<class _T>
+    static _U apply(const _T& val){
+        if constexpr(internal::is_half_v<_T>){
+            return cast_to::apply(static_cast<float>(val));
+        }else if constexpr(internal::is_half_v<_U> && std::is_arithmetic_v<_T>){
+            float x = cast_to<float, false, _Saturate>::apply(val);
+            if constexpr(_Saturate){
+                constexpr float hi = std::numeric_limits<_U>::max();
+                x = x < -hi? -hi: x;
+                x = x > hi? hi: x;
+            }
+            return _U(x);
+        }else if constexpr(!std::is_arithmetic_v<_T> || !std::is_arithmetic_v<_U> || std::is_same_v<_U, bool>){
+            return static_cast<_U>(val);
+        }else{
+            _T x = val;
+            if constexpr(_Round && std::is_floating_point_v<_T> && std::is_integral_v<_U>)
+                x = std::rint(x);
+            constexpr bool narrows = std::is_integral_v<_U> || sizeof(_U) < sizeof(_T);
+            if constexpr(_Saturate && narrows){
+                constexpr _T lo = cast_lower<_T, _U>(), hi = cast_upper<_T, _U>();
+                if constexpr(std::is_floating_point_v<_T> && std::is_integral_v<_U>){
+                    x = x == x? x: _T(0);
+                    x = x < lo? lo: x;
+                    bool over = x > hi;
+                    _U res = static_cast<_U>(over? hi: x);
+                    return over? std::numeric_limits<_U>::max(): res;
+                }
+                x = x < lo? lo: x;
+                x = x > hi? hi: x;
+            }
+            return static_cast<_U>(x);
+        }
+    }
+};
+
+/*dst[i * ds] = cast_to<_U, _Round, _Saturate>(src[i * ss]) for i in [0, n).*/
+template<bool _Round, bool _Saturate, class _T, class _U>
+void convert(const _T* src, size_t ss, _U* dst, size_t ds, size_t n){
+    using cast = cast_to<_U, _Round, _Saturate>;
+    if constexpr(std::is_same_v<_T, float> && internal::is_half_v<_U> && !_Saturate){
+        if(ss == 1 && ds == 1)
+            return narrow(src, dst, n);
+    }else if constexpr(internal::is_half_v<_T> && std::is_same_v<_U, float>){
+        if(ss == 1 && ds == 1)
+            return widen(src, dst, n);
+    }
+    if(ss == 1 && ds == 1)
+        simd_for<true>(n, [=](size_t i){ dst[i] = cast::apply(src[i]); });
+    else
+        simd_for<true>(n, [=](size_t i){ dst[i * ds] = cast::apply(src[i * ss]); });
+}
+
+/*
+    Element comparisons for bit masks. pred is the matching _mm256_cmp_ps /
+    _mm256_cmp_pd predicate; unordered operands (NaN) compare false.
+*/
+#ifdef _MAT_X86
+#define _SIMD_CMP_KERNEL(name, op, pred)\
+struct name{\
+    static constexpr int avx_pred = pred;\
+    template<typename _Ty, typename _T>\
+    static bool apply(const _Ty& a, const _T& b){\
+        return a op b;\
+    }\
+};
+#else
+#define _SIMD_CMP_KERNEL(name, op, pred)\
+struct name{\
+    template<typename _Ty, typename _T>\
+    static bool apply(const _Ty& a, const _T& b){\
+        return a op b;\
+    }\
+};
+#endif
+
+_SIMD_CMP_KERNEL(cmp_lt, <, _CMP_LT_OQ)
+_SIMD_CMP_KERNEL(cmp_le, <=, _CMP_LE_OQ)
+_SIMD_CMP_KERNEL(cmp_gt, >, _CMP_GT_OQ)
+_SIMD_CMP_KERNEL(cmp_ge, >=, _CMP_GE_OQ)
+
+#undef _SIMD_CMP_KERNEL
+
+#ifdef _MAT_X86
+
+/*cmp_bits of 64 contiguous floats or doubles, b contiguous (sb == 1) or broadcast (sb == 0).*/
+template<class _Cmp>
+_MAT_TARGET("avx2")
+uint64_t cmp_bits_avx2(const float* a, const float* b, size_t sb){
+    __m256 vb = _mm256_set1_ps(*b);
+    uint64_t res = 0;
+    for(size_t i = 0; i < 64; i += 8){
+        if(sb)
+            vb = _mm256_loadu_ps(b + i);
+        __m256 c = _mm256_cmp_ps(_mm256_loadu_ps(a + i), vb, _Cmp::avx_pred);
+        res |= uint64_t(_mm256_movemask_ps(c)) << i;
+    }
+    return res;
+}
+
+template<class _Cmp>
+_MAT_TARGET("avx2")
+uint64_t cmp_bits_avx2(const double* a, const double* b, size_t sb){
+    __m256d vb = _mm256_set1_pd(*b);
+    uint64_t res = 0;
+    for(size_t i = 0; i < 64; i += 4){
+        if(sb)
+            vb = _mm256_loadu_pd(b + i);
+        __m256d c = _mm256_cmp_pd(_mm256_loadu_pd(a + i), vb, _Cmp::avx_pred);
+        res |= uint64_t(_mm256_movemask_pd(c)) << i;
+    }
+    return res;
+}
+
+template<class _Cmp>
+_MAT_TARGET("avx512f")
+uint64_t cmp_bits_avx512(const float* a, const float* b, size_t sb){
+    __m512 vb = _mm512_set1_ps(*b);
+    uint64_t res = 0;
+    for(size_t i = 0; i < 64; i += 16){
+        if(sb)
+            vb = _mm512_loadu_ps(b + i);
+        res |= uint64_t(_mm512_cmp_ps_mask(_mm512_loadu_ps(a + i), vb, _Cmp::avx_pred)) << i;
+    }
+    return res;
+}
+
+template<class _Cmp>
+_MAT_TARGET("avx512f")
+uint64_t cmp_bits_avx512(const double* a, const double* b, size_t sb){
+    __m512d vb = _mm512_set1_pd(*b);
+    uint64_t res = 0;
+    for(size_t i = 0; i < 64; i += 8){
+        if(sb)
+            vb = _mm512_loadu_pd(b + i);
+        res |= uint64_t(_mm512_cmp_pd_mask(_mm512_loadu_pd(a + i), vb, _Cmp::avx_pred)) << i;
+    }
+    return res;
+}
+
+#endif
+
+/*
+    Bits of _Cmp::apply(a[i * sa], b[i * sb]) for i in [0, n), n <= 64, bit i
+    of the result for element i. A step of 0 broadcasts a single value.
+    Full words of floats or doubles go through the kernel of simd_level().
+*/
+template<class _Cmp, typename _Ty, typename _T>
+uint64_t cmp_bits(const _Ty* a, size_t sa, const _T* b, size_t sb, size_t n){
+#ifdef _MAT_X86
+    if constexpr(std::is_same_v<_Ty, _T> && (std::is_same_v<_Ty, float> || std::is_same_v<_Ty, double>)){
+        if(n == 64 && sa == 1 && sb <= 1){
+            SimdLevel level = internal::simd_level();
+            if(level >= SIMD_AVX512)
+                return cmp_bits_avx512<_Cmp>(a, b, sb);
+            if(level >= SIMD_AVX2)
+                return cmp_bits_avx2<_Cmp>(a, b, sb);
+        }
+    }
+#endif
+    uint64_t res = 0;
+    for(size_t i = 0; i < n; ++i)
+        res |= uint64_t(_Cmp::apply(a[i * sa], b[i * sb])) << i;
+    return res;
+}
+
+/*
+    Fold cur[l, r) into an accumulator with fn(acc, ele). Arithmetic
+    accumulators are split into several independent lanes, so the loop is
+    bound by throughput rather than by the latency of a single chain; the
+    lanes are merged with comb(acc, other) at the end. Other accumulator
+    types keep the plain in-order loop.
+*/
+template<class _Cur, class _Acc, class _Fn, class _Comb>
+_Acc reduce(const _Cur& cur, size_t l, size_t r, const _Acc& init, _Fn fn, _Comb comb){
+    constexpr size_t lanes = std::is_arithmetic_v<_Acc> ? 128 / sizeof(_Acc) : 1;
+
+    if constexpr(lanes == 1){
+        _Acc acc = init;
+        for(size_t i = l; i < r; ++i)
+            fn(acc, cur[i]);
+        return acc;
+    }else{
+        _Acc acc[lanes];
+        for(size_t k = 0; k < lanes; ++k)
+            acc[k] = init;
+
+        size_t i = l;
+        for(; i + lanes <= r; i += lanes){
+            #pragma omp simd
+            for(size_t k = 0; k < lanes; ++k)
+                fn(acc[k], cur[i + k]);
+        }
+        for(; i < r; ++i)
+            fn(acc[0], cur[i]);
+
+        for(size_t w = lanes / 2; w > 0; w /= 2)
+            for(size_t k = 0; k < w; ++k)
+                comb(acc[k], acc[k + w]);
+        return acc[0];
+    }
+}
+
 }; // namespace simd
 }; // namespace zmat
@@ -0,0 +1,213 @@
+#pragma once
+
+#include<cstddef>
+#include<cstring>
+#include<stdint.h>
+#include<algorithm>
+#include<memory>
+#include<numeric>
+#include<vector>
+#include<type_traits>
+#include "utils.h"
+
+#ifdef _MAT_X86
+#include<immintrin.h>
+#endif
+
+namespace zmat{
+
+namespace internal{
+
+/*
+    Tiled transpose. Both matrices are walked in square tiles that fit in L1
+    together, tile rows are spread across threads. Inside a tile, 4- and
+    8-byte trivially copyable elements with a unit source column step are
+    moved as 8x8 / 4x4 register blocks (AVX2 shuffles), the rest one by one.
+*/
+
+/*edge of a tile, in elements.*/
+template<class _Ty>
+constexpr size_t transpose_tile = sizeof(_Ty) >= 4? 32: 64;
+
+/*elements that move as raw 4- or 8-byte words in the register kernels.*/
+template<class _Ty>
+constexpr bool transpose_words = std::is_trivially_copyable_v<_Ty> && (sizeof(_Ty) == 4 || sizeof(_Ty) == 8);
+
+/*dst[j][i] = src[i][j] for an m x n block.*/
+template<class _Ty>
+void transpose_block(const _Ty* src, size_t rs, size_t cs, _Ty* dst, size_t rd, size_t m, size_t n){
+    for(size_t i = 0; i < m; ++i)
+        for(size_t j = 0; j < n; ++j)
+            dst[j * rd + i] = src[i * rs + j * cs];
+}
+
+#ifdef _MAT_X86
+
+_MAT_TARGET("avx2")
+inline void transpose_8x8(const float* src, size_t rs, float* dst, size_t rd){
+    __m256 r0 = _mm256_loadu_ps(src),          r1 = _mm256_loadu_ps(src + rs);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * rs), r3 = _mm256_loadu_ps(src + 3 * rs);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * rs), r5 = _mm256_loadu_ps(src + 5 * rs);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * rs), r7 = _mm256_loadu_ps(src + 7 * rs);
+
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+    r0 = _mm256_shuffle_ps(t0, t2, 0x44); r1 = _mm256_shuffle_ps(t0, t2, 0xee);
+    r2 = _mm256_shuffle_ps(t1, t3, 0x44); r3 = _mm256_shuffle_ps(t1, t3, 0xee);
+    r4 = _mm256_shuffle_ps(t4, t6, 0x44); r5 = _mm256_shuffle_ps(t4, t6, 0xee);
+    r6 = _mm256_shuffle_ps(t5, t7, 0x44); r7 = _mm256_shuffle_ps(t5, t7, 0xee);
+
+    _mm256_storeu_ps(dst,          _mm256_permute2f128_ps(r0, r4, 0x20));
+    _mm256_storeu_ps(dst + rd,     _mm256_permute2f128_ps(r1, r5, 0x20));
+    _mm256_storeu_ps(dst + 2 * rd, _mm256_permute2f128_ps(r2, r6, 0x20));
+    _mm256_storeu_ps(dst + 3 * rd, _mm256_permute2f128_ps(r3, r7, 0x20));
+    _mm256_storeu_ps(dst + 4 * rd, _mm256_permute2f128_ps(r0, r4, 0x31));
+    _mm256_storeu_ps(dst + 5 * rd, _mm256_permute2f128_ps(r1, r5, 0x31));
+    _mm256_storeu_ps(dst + 6 * rd, _mm256_permute2f128_ps(r2, r6, 0x31));
+    _mm256_storeu_ps(dst + 7 * rd, _mm256_permute2f128_ps(r3, r7, 0x31));
+}
+
+_MAT_TARGET("avx2")
+inline void transpose_4x4(const double* src, size_t rs, double* dst, size_t rd){
+    __m256d r0 = _mm256_loadu_pd(src),          r1 = _mm256_loadu_pd(src + rs);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * rs), r3 = _mm256_loadu_pd(src + 3 * rs);
+
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+
+    _mm256_storeu_pd(dst,          _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + rd,     _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * rd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * rd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+/*transpose_block for a unit source column step, register blocks over the bulk and scalars on the edges.*/
+template<class _Ty>
+_MAT_TARGET("avx2")
+void transpose_block_avx2(const _Ty* src, size_t rs, _Ty* dst, size_t rd, size_t m, size_t n){
+    using word = std::conditional_t<sizeof(_Ty) == 4, float, double>;
+    constexpr size_t B = 32 / sizeof(_Ty);
+    auto s = reinterpret_cast<const word*>(src);
+    auto d = reinterpret_cast<word*>(dst);
+    size_t mb = m / B * B, nb = n / B * B;
+    for(size_t i = 0; i < mb; i += B)
+        for(size_t j = 0; j < nb; j += B){
+            if constexpr(B == 8)
+                transpose_8x8(s + i * rs + j, rs, d + j * rd + i, rd);
+            else
+                transpose_4x4(s + i * rs + j, rs, d + j * rd + i, rd);
+        }
+    if(nb < n)
+        transpose_block(src + nb, rs, 1, dst + nb * rd, rd, m, n - nb);
+    if(mb < m)
+        transpose_block(src + mb * rs, rs, 1, dst + mb, rd, m - mb, nb);
+}
+
+#endif
+
+/*transpose_block with the fastest kernel the elements and the cpu allow.*/
+template<class _Ty>
+void transpose_tile_run(const _Ty* src, size_t rs, size_t cs, _Ty* dst, size_t rd, size_t m, size_t n){
+#ifdef _MAT_X86
+    if constexpr(transpose_words<_Ty>){
+        if(cs == 1 && simd_level() >= SIMD_AVX2)
+            return transpose_block_avx2(src, rs, dst, rd, m, n);
+    }
+#endif
+    transpose_block(src, rs, cs, dst, rd, m, n);
+}
+
+/*dst[j][i] = src[i][j] for an M x N source with steps (rs, cs) and a unit column step destination.*/
+template<class _Ty>
+void transpose_copy(const _Ty* src, size_t rs, size_t cs, _Ty* dst, size_t rd, size_t M, size_t N){
+    constexpr size_t T = transpose_tile<_Ty>;
+    size_t bands = (M + T - 1) / T;
+    parallel_for_range(bands, parallel_threads(M * N), [&](size_t l, size_t r){
+        for(size_t i = l * T; i < std::min(M, r * T); i += T)
+            for(size_t j = 0; j < N; j += T)
+                transpose_tile_run(src + i * rs + j * cs, rs, cs, dst + j * rd + i, rd,
+                                   std::min(T, M - i), std::min(T, N - j));
+    });
+}
+
+/*
+    in-place transpose of an n x n matrix with row step rs: tiles below the
+    diagonal are swapped with their mirror images through a tile buffer.
+*/
+template<class _Ty>
+void transpose_square(_Ty* ptr, size_t rs, size_t n){
+    constexpr size_t T = transpose_tile<_Ty>;
+    size_t bands = (n + T - 1) / T;
+    size_t nth = parallel_threads(n * n);
+
+    #pragma omp parallel num_threads(nth) if(nth > 1)
+    {
+        std::unique_ptr<_Ty[]> buf(new _Ty[T * T]);
+        /*band i holds i + 1 tiles, dynamic scheduling evens that out.*/
+        #pragma omp for schedule(dynamic)
+        for(size_t bi = 0; bi < bands; ++bi){
+            size_t i = bi * T, m = std::min(T, n - i);
+            for(size_t j = 0; j <= i; j += T){
+                size_t w = std::min(T, n - j);
+                _Ty* a = ptr + i * rs + j;
+                _Ty* b = ptr + j * rs + i;
+                /*buf = a^T, a = b^T, b = buf, the diagonal tile being both a and b.*/
+                transpose_tile_run(a, rs, size_t(1), buf.get(), m, m, w);
+                if(j != i)
+                    transpose_tile_run(b, rs, size_t(1), a, rs, w, m);
+                for(size_t r = 0; r < w; ++r)
+                    std::copy_n(buf.get() + r * m, m, b + r * rs);
+            }
+        }
+    }
+}
+
+/*
+    in-place transpose of a dense M x N matrix, g = gcd(M, N). The matrix is
+    a (M / g) x (N / g) grid of g x g blocks: each block is transposed where
+    it is, which leaves rows of the result in place as runs of g values,
+    then the runs are moved to their final slots by following the cycles of
+    that permutation. One bit per run marks what has moved and the only
+    other storage is a single run, so a square matrix needs nothing and one
+    with a side a multiple of the other moves whole rows.
+*/
+template<class _Ty>
+void transpose_inplace(_Ty* ptr, size_t M, size_t N){
+    size_t g = std::gcd(M, N), p = M / g, q = N / g;
+    for(size_t I = 0; I < p; ++I)
+        for(size_t J = 0; J < q; ++J)
+            transpose_square(ptr + I * g * N + J * g, N, g);
+    if(p == 1 && q == 1)
+        return;
+
+    /*the run of block row I, row r, block column J goes from (I, r, J) in a p x g x q grid to (J, r, I) in q x g x p.*/
+    size_t total = p * g * q;
+    std::vector<uint64_t> moved((total + 63) / 64, 0);
+    std::unique_ptr<_Ty[]> hold(new _Ty[g]);
+    auto run = [&](size_t k){ return ptr + k * g; };
+
+    for(size_t start = 0; start < total; ++start){
+        if(moved[start / 64] >> (start % 64) & 1)
+            continue;
+        /*walk the cycle backwards: slot cur receives the run that belongs there, from prev.*/
+        std::copy_n(run(start), g, hold.get());
+        size_t cur = start;
+        while(true){
+            moved[cur / 64] |= uint64_t(1) << (cur % 64);
+            size_t J = cur / (g * p), r = cur / p % g, I = cur % p;
+            size_t prev = (I * g + r) * q + J;
+            if(prev == start)
+                break;
+            std::copy_n(run(prev), g, run(cur));
+            cur = prev;
+        }
+        std::copy_n(hold.get(), g, run(cur));
+    }
+}
+
+} // namespace internal
+
+} // namespace zmat
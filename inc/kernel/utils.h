@@ -5,6 +5,14 @@
 #include <sstream>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define _MAT_X86
+/*compile one function for the given instruction set, whatever the TU flags are.*/
+#define _MAT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define _MAT_TARGET(isa)
+#endif
+
 namespace zmat{
 
 namespace zutil{
@@ -22,6 +30,32 @@ std::string as_str(Types ...args){
     
 } //namespace zutil
 
+/*
+    Storage allocator behind MatrixData. deallocate receives the same size
+    and alignment that were passed to allocate.
+*/
+struct mat_allocator{
+    void* (*allocate)(size_t bytes, size_t align);
+    void (*deallocate)(void* ptr, size_t bytes, size_t align);
+};
+
+/*
+    Instruction set tiers of the dispatched kernels (gemm micro kernels and
+    mask comparisons), each level implies the ones below it.
+*/
+enum SimdLevel{
+    SIMD_GENERIC = 0,   //whatever the TU is compiled for
+    SIMD_SSE42 = 1,
+    SIMD_AVX2 = 2,      //AVX2 and FMA
+    SIMD_AVX512 = 3     //AVX-512F
+};
+
+struct mat_alloc_stats{
+    size_t allocations;     //requests served by the caching allocator
+    size_t cache_hits;      //of which were served from a free list
+    size_t cached_bytes;    //bytes currently held in free lists, all threads
+};
+
 namespace internal{
 
 template<class _Ty, size_t Dim>
@@ -61,8 +95,54 @@ void collect_shape(const init_val_base<_Ty, _N>& base, _It dst){
 
 struct mat_setting{
     static double eps;
+    static size_t num_threads;          //0: use the OpenMP default
+    static size_t parallel_threshold;   //work below this stays serial
+    static size_t alignment;            //bytes, alignment of new matrix storage
+    static bool row_padding;            //pad the row pitch of new matrices
+    static mat_allocator allocator;
+    static size_t alloc_cache_limit;    //bytes each thread may keep cached
+    static size_t memory_budget;        //bytes of operand tiles gemm_out_of_core keeps resident
+    static SimdLevel simd_level;        //kernel variant in use, detected at startup
 };
 
+inline SimdLevel simd_level(){
+    return mat_setting::simd_level;
+}
+
+/*AVX-512 VNNI, which the int8 kernels of SIMD_AVX512 use when the cpu has it.*/
+bool cpu_has_vnni();
+
+/*number of threads to use for a job of the given size, 1 if it should stay serial.*/
+size_t parallel_threads(size_t work);
+
+/*
+    row pitch (in elements) for a new matrix whose rows hold cols elements of
+    size elem. With row padding on, rows start on an alignment boundary and
+    a pitch that is a multiple of 4K gets one more alignment unit, so that
+    consecutive rows do not alias in the cache.
+*/
+size_t padded_pitch(size_t cols, size_t elem);
+
+/*
+    steps viewing n elements laid out by (sizes, steps), dim axes, under
+    nsizes (ndim axes, same element count) without moving any of them.
+    false if the layout does not allow it, nsteps is garbage then.
+*/
+bool reshape_steps(const size_t* sizes, const size_t* steps, size_t dim,
+                   const size_t* nsizes, size_t* nsteps, size_t ndim);
+
+/*split [0, n) into nth contiguous ranges and call fn(l, r) on each, in parallel.*/
+template<class _Fn>
+void parallel_for_range(size_t n, size_t nth, _Fn fn){
+    if(nth <= 1){
+        fn(0, n);
+        return;
+    }
+    #pragma omp parallel for num_threads(nth) schedule(static)
+    for(size_t t = 0; t < nth; ++t)
+        fn(n * t / nth, n * (t + 1) / nth);
+}
+
 };//namespace internal
 
 
@@ -75,4 +155,49 @@ struct Range{
 void mat_set_eps(double eps);
 double mat_get_eps();
 
+void mat_set_num_threads(size_t num);
+size_t mat_get_num_threads();
+
+void mat_set_parallel_threshold(size_t work);
+size_t mat_get_parallel_threshold();
+
+void mat_set_alignment(size_t bytes);
+size_t mat_get_alignment();
+
+void mat_set_row_padding(bool pad);
+bool mat_get_row_padding();
+
+/*plain aligned new/delete, nothing is cached.*/
+mat_allocator mat_system_allocator();
+/*
+    the default: freed buffers go to thread-local free lists, one per size
+    class (four per power of two), and are handed out again to the next
+    request of that class on the same thread.
+*/
+mat_allocator mat_caching_allocator();
+
+void mat_set_allocator(const mat_allocator& alloc);
+mat_allocator mat_get_allocator();
+
+void mat_set_alloc_cache_limit(size_t bytes);
+size_t mat_get_alloc_cache_limit();
+
+void mat_set_memory_budget(size_t bytes);
+size_t mat_get_memory_budget();
+
+/*highest level the cpu (and the OS) supports, from cpuid.*/
+SimdLevel mat_detect_simd_level();
+/*
+    select the kernel variants, throws if the cpu does not support level.
+    The initial level is the detected one, or the ZMAT_SIMD environment
+    variable (generic, sse4.2, avx2 or avx512) if it names a supported level.
+*/
+void mat_set_simd_level(SimdLevel level);
+SimdLevel mat_get_simd_level();
+const char* mat_simd_level_name(SimdLevel level);
+
+mat_alloc_stats mat_get_alloc_stats();
+/*release the free lists of the calling thread, returns the bytes freed.*/
+size_t mat_alloc_trim();
+
 };//namespace zmat
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "utils.h"
+#include "iter.h"
+#include <array>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+namespace zmat{
+
+namespace internal{
+
+/*one operand of a stride walk: a base pointer and its element steps.*/
+template<class _Ty, size_t Dim>
+struct walk_operand{
+    _Ty* ptr;
+    shape_type<Dim> steps;
+};
+
+/*a run of elements handed to the walk body, element j is ptr[j * step].*/
+template<class _Ty>
+struct walk_span{
+    _Ty* ptr;
+    size_t step;
+
+    _Ty& operator[](size_t j) const{
+        return ptr[j * step];
+    }
+
+    bool unit() const{
+        return step == 1;
+    }
+};
+
+template<size_t Dim, class _Fn, size_t ..._Is, class ..._Ts>
+void stride_walk_impl(const shape_type<Dim>& shape, size_t nth, _Fn& fn,
+                      std::index_sequence<_Is...>, const walk_operand<_Ts, Dim>& ...ops){
+    constexpr size_t K = sizeof...(_Ts);
+    const shape_type<Dim>* src[K] = {&ops.steps...};
+    std::tuple<_Ts*...> base{ops.ptr...};
+
+    shape_type<Dim> sz{};
+    std::array<shape_type<Dim>, K> st{};
+    size_t nd = 0;
+
+    for(size_t i = 0; i < Dim; ++i){
+        if(shape[i] == 0)
+            return;
+        if(shape[i] == 1)
+            continue;
+        bool merge = nd > 0;
+        for(size_t k = 0; k < K && merge; ++k)
+            merge = st[k][nd - 1] == (*src[k])[i] * shape[i];
+        if(merge){
+            sz[nd - 1] *= shape[i];
+        }else{
+            sz[nd++] = shape[i];
+        }
+        for(size_t k = 0; k < K; ++k)
+            st[k][nd - 1] = (*src[k])[i];
+    }
+    if(nd == 0){
+        nd = 1;
+        sz[0] = 1;
+    }
+
+    size_t len = sz[nd - 1], rows = 1;
+    for(size_t i = 0; i + 1 < nd; ++i)
+        rows *= sz[i];
+
+    auto run = [&](const std::array<size_t, K>& off, size_t l, size_t r){
+        fn(r - l, walk_span<_Ts>{std::get<_Is>(base) + off[_Is] + l * st[_Is][nd - 1], st[_Is][nd - 1]}...);
+    };
+
+    if(rows == 1){
+        parallel_for_range(len, nth, [&](size_t l, size_t r){
+            run(std::array<size_t, K>{}, l, r);
+        });
+        return;
+    }
+
+    parallel_for_range(rows, std::min(nth, rows), [&](size_t l, size_t r){
+        shape_type<Dim> idx{};
+        std::array<size_t, K> off{};
+        for(size_t i = nd - 1, rem = l; i-- > 0;){
+            idx[i] = rem % sz[i];
+            rem /= sz[i];
+            for(size_t k = 0; k < K; ++k)
+                off[k] += idx[i] * st[k][i];
+        }
+        for(size_t row = l; row < r; ++row){
+            run(off, 0, len);
+            for(size_t i = nd - 1; i-- > 0;){
+                for(size_t k = 0; k < K; ++k)
+                    off[k] += st[k][i];
+                if(++idx[i] < sz[i])
+                    break;
+                for(size_t k = 0; k < K; ++k)
+                    off[k] -= sz[i] * st[k][i];
+                idx[i] = 0;
+            }
+        }
+    });
+}
+
+/*
+    Loop over a shape shared by several operands. Size-1 dimensions are
+    dropped and adjacent dimensions are merged whenever every operand's
+    steps allow it, so an ROI of a matrix walks as rows and a contiguous
+    matrix as a single run. fn(len, spans...) is called once per innermost
+    run. Rows are split over nth threads, or the run itself when there is
+    only one; with nth == 1 runs are visited in row-major order.
+*/
+template<size_t Dim, class _Fn, class ..._Ts>
+void stride_walk(const shape_type<Dim>& shape, size_t nth, _Fn fn, const walk_operand<_Ts, Dim>& ...ops){
+    stride_walk_impl(shape, nth, fn, std::index_sequence_for<_Ts...>(), ops...);
+}
+
+};//namespace internal
+
+};//namespace zmat
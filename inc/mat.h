@@ -3,7 +3,10 @@
 #include "kernel/iter.h"
 #include "kernel/data.h"
 #include "kernel/utils.h"
+#include "kernel/half.h"
 #include "kernel/formatter.h"
+#include "kernel/walker.h"
+#include <string_view>
 
 namespace zmat{
 
@@ -11,9 +14,23 @@ enum MatFlag{
     CONTINUOUS_FLAG = 0x1, VIEW_FLAG = 0x2
 };
 
+/*conversion modes of astype, CAST_ROUND and CAST_SATURATE can be combined.*/
+enum CastMode{
+    CAST_TRUNC = 0x0, CAST_ROUND = 0x1, CAST_SATURATE = 0x2
+};
+
 template<class _Ty, size_t Dim>
 class Matrix;
 
+template<class _Ty, size_t _R, size_t _C>
+class SMatrix;
+
+template<class _Ty, size_t Dim>
+class MatRef;
+
+template<size_t Dim>
+class Mask;
+
 template<typename _Ty>
 struct is_matrix : std::false_type {};
 
@@ -24,6 +41,28 @@ struct is_matrix<Matrix<_Ele, _Dim>> : std::true_type {};
 template<typename _Ty>
 constexpr bool is_matrix_v = is_matrix<std::decay_t<_Ty>>::value;
 
+template<class _Op, class _L, class _R>
+class MatExpr;
+
+template<typename _Ty>
+struct is_mat_expr : std::false_type {};
+
+template<class _Op, class _L, class _R>
+struct is_mat_expr<MatExpr<_Op, _L, _R>> : std::true_type {};
+
+/*test if a type is an unevaluated elementwise expression.*/
+template<typename _Ty>
+constexpr bool is_mat_expr_v = is_mat_expr<std::decay_t<_Ty>>::value;
+
+/*test if a type is Matrix type or an expression evaluating to one.*/
+template<typename _Ty>
+constexpr bool is_mat_like_v = is_matrix_v<_Ty> || is_mat_expr_v<_Ty>;
+
+namespace internal{
+template<class _Ty, size_t Dim>
+struct expr_leaf;
+}
+
 template<class _Ty, size_t Dim>
 class Matrix{
     static_assert(Dim >= 1, "Dimension could not less than 1");
@@ -53,7 +92,9 @@ private:
     using self = Matrix<_Ty, Dim>;
 
     data_manager _raw_data;
-    std::shared_ptr<formatter<_Ty>> fmt = std::make_shared<def_fmt>();
+    std::shared_ptr<formatter<_Ty>> fmt;     //null: the shared default format
+
+    static const std::shared_ptr<formatter<_Ty>>& default_format();
 
     shape_t _sizes, _steps;
 
@@ -61,8 +102,14 @@ private:
 
     pointer start_ptr;
 
+    /*sizes and steps of a new matrix, rows padded as mat_set_row_padding asks.*/
+    template<class _It>
+    void init_layout(_It arg);
     template<class _It, class ..._Args>
     void init_shape(_It arg, _Args ...args);
+    /*init_shape for a result about to be overwritten: trivial elements are left uninitialized.*/
+    template<class _It>
+    void init_uninit(_It arg);
 
     template<class _It1, class _It2>
     Matrix(pointer st_ptr, data_manager raw, _It1 shape_it, _It2 step_it);
@@ -110,6 +157,9 @@ public:
 
     Matrix(pointer ptr, const std::vector<size_t>& sizes);
 
+    template<class _Op, class _L, class _R>
+    Matrix(const MatExpr<_Op, _L, _R>& expr);
+
     template<_MAT_DIM_RESTRICT(_N == 2)>
     Matrix(pointer ptr, const size_t x, const size_t y);
 
@@ -189,6 +239,10 @@ public:
     template<class ...Types, std::enable_if_t<(sizeof...(Types) <= Dim), size_t> _ = 0>
     const sub_type_of<sizeof...(Types)> at(Types ...indices) const;
 
+    /*non-owning view of this matrix, valid while its data is alive.*/
+    MatRef<_Ty, Dim> ref();
+    MatRef<const _Ty, Dim> ref() const;
+
     void print(std::ostream& out, std::shared_ptr<formatter<_Ty>> fmt = nullptr) const;
 
     self& operator =(const self &mat);
@@ -218,13 +272,39 @@ public:
     void transpose();
     template<_MAT_DIM_RESTRICT(_N <= 2)>
     Matrix<_Ty, 2> transposed() const;
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    self t();
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    const self t() const;
+
+    /*views with the axes reordered, axis i of the view being axis Axes[i] of this.*/
+    template<size_t ...Axes>
+    self permute();
+    template<size_t ...Axes>
+    const self permute() const;
+    self swapaxes(size_t a, size_t b);
+    const self swapaxes(size_t a, size_t b) const;
+
+    /*view with a new axis of size 1 before axis (after the last one for axis == Dim).*/
+    Matrix<_Ty, Dim + 1> expand_dims(size_t axis);
+    const Matrix<_Ty, Dim + 1> expand_dims(size_t axis) const;
+    /*view without axis, which has to be of size 1.*/
+    template<_MAT_DIM_RESTRICT(_N >= 2)>
+    Matrix<_Ty, _N - 1> squeeze(size_t axis);
+    template<_MAT_DIM_RESTRICT(_N >= 2)>
+    const Matrix<_Ty, _N - 1> squeeze(size_t axis) const;
 
-    template<class _T>
-    Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim>
-    mul(const Matrix<_T, Dim>& b) const;
+    template<class _T, std::enable_if_t<is_mat_like_v<_T>, size_t> _ = 0>
+    auto mul(const _T& b) const;
     
+    /*in place, throws when the steps cannot express the new shape without moving elements.*/
     template<class ...Types, std::enable_if_t<(sizeof...(Types) == Dim), size_t> _ = 0>
     void reshape(Types ...args);
+    /*a view under the new shape when the steps allow it, otherwise a continuous copy.*/
+    template<class ...Types>
+    Matrix<_Ty, sizeof...(Types)> reshaped(Types ...args);
+    template<class ...Types>
+    const Matrix<_Ty, sizeof...(Types)> reshaped(Types ...args) const;
 
     template<class _Tp = _Ty, class ...Types>
     Matrix<_Tp, sizeof...(Types)> reinterpret(Types ...args) const;
@@ -234,41 +314,24 @@ public:
     template<class _Res, class _Fn, std::enable_if_t<std::is_invocable_r_v<_Res, _Fn, const _Ty&>, size_t> _ = 0>
     Matrix<_Res, Dim> maps(_Fn mapper) const;
 
+    /*copy converted to _U, mode is a combination of CastMode flags.*/
+    template<class _U>
+    Matrix<_U, Dim> astype(int mode = CAST_TRUNC) const;
+
     void fill(const _Ty&);
-    template<class _T>
-    self& operator <<=(const Matrix<_T, Dim> &mat);
-    template<class _T>
+    /*element-wise copy, mat is broadcast to this shape.*/
+    template<class _T, size_t _N>
+    self& operator <<=(const Matrix<_T, _N> &mat);
+    template<class _Op, class _L, class _R>
+    self& operator <<=(const MatExpr<_Op, _L, _R>& expr);
+    template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _ = 0>
     self& operator <<=(const _T& val);
 
-    template<class _T>
-    Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim>
-    operator +(const Matrix<_T, Dim>&) const;
-
-    template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _ = 0>
-    Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim>
-    operator +(const _T&) const;
-
-    template<class _T1, class _T2, size_t _N, std::enable_if_t<!is_matrix_v<_T1>, size_t> _>
-    friend Matrix<decltype(std::declval<_T1>() + std::declval<_T2>()), _N>
-    operator +(const _T1&, const Matrix<_T2, _N>&);
-
     template<class _T>
     self& operator +=(const Matrix<_T, Dim>&);
     template<class _T>
     self& operator +=(const _T&);
 
-    template<class _T>
-    Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim>
-    operator -(const Matrix<_T, Dim>&) const;
-
-    template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _ = 0>
-    Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim>
-    operator -(const _T&) const;
-
-    template<class _T1, class _T2, size_t _N, std::enable_if_t<!is_matrix_v<_T1>, size_t> _>
-    friend Matrix<decltype(std::declval<_T1>() - std::declval<_T2>()), _N>
-    operator -(const _T1&, const Matrix<_T2, _N>&);
-
     template<class _T>
     self& operator -=(const Matrix<_T, Dim>&);
     template<class _T>
@@ -279,51 +342,48 @@ public:
     template<_MAT_DIM_RESTRICT(_N == 2)>
     self operator *(const Matrix<_Ty, 1>&) const;
     template<_MAT_DIM_RESTRICT(_N == 2)>
-    self& operator *=(const self&) const;
+    self& operator *=(const self&);
 
     template<_MAT_DIM_RESTRICT(_N == 1)>
     _Ty operator *(const Matrix<_Ty, _N>&) const;
     template<_MAT_DIM_RESTRICT(_N == 1)>
     self operator *(const Matrix<_Ty, 2>&) const;
 
-
-    template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _ = 0>
-    Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim>
-    operator *(const _T&) const;
-
     template<class _T>
-    self& operator *=(const _T&) const;
-
-    template<class _T1, class _T2, size_t _N, std::enable_if_t<!is_matrix_v<_T1>, size_t> _>
-    friend Matrix<decltype(std::declval<_T1>() * std::declval<_T2>()), _N>
-    operator *(const _T1&, const Matrix<_T2, _N>&);
+    self& operator *=(const _T&);
 
     template<class _T>
-    Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim>
-    operator /(const Matrix<_T, Dim>&) const;
-
-    template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _ = 0>
-    Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim>
-    operator /(const _T&) const;
-
-    template<class _T1, class _T2, size_t _N, std::enable_if_t<!is_matrix_v<_T1>, size_t> _>
-    friend Matrix<decltype(std::declval<_T1>() / std::declval<_T2>()), _N>
-    operator /(const _T1&, const Matrix<_T2, _N>&);
+    self& operator /=(const _T&);
 
     template<class _T>
-    self& operator /=(const _T&) const;
-
+    self& operator /=(const Matrix<_T, Dim>&);
+
+    /*element-wise comparisons, one bit per element. Matrix operands are broadcast against each other.*/
+    template<class _T, size_t _N>
+    Mask<(Dim > _N? Dim: _N)> operator <=(const Matrix<_T, _N>&) const;
+    template<class _T, size_t _N>
+    Mask<(Dim > _N? Dim: _N)> operator >=(const Matrix<_T, _N>&) const;
+    template<class _T, size_t _N>
+    Mask<(Dim > _N? Dim: _N)> operator <(const Matrix<_T, _N>&) const;
+    template<class _T, size_t _N>
+    Mask<(Dim > _N? Dim: _N)> operator >(const Matrix<_T, _N>&) const;
+
+    template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _ = 0>
+    Mask<Dim> operator <=(const _T&) const;
+    template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _ = 0>
+    Mask<Dim> operator >=(const _T&) const;
+    template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _ = 0>
+    Mask<Dim> operator <(const _T&) const;
+    template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _ = 0>
+    Mask<Dim> operator >(const _T&) const;
+
+    /*elements where mask is set, in row-major order; a null matrix if there are none.*/
+    Matrix<_Ty, 1> select(const Mask<Dim>& mask) const;
+
+    /*overwrite the elements where mask is set.*/
+    self& assign(const Mask<Dim>& mask, const _Ty& val);
     template<class _T>
-    self& operator /=(const Matrix<_T, Dim>&) const;
-
-    template<class _T>
-    Matrix<bool, Dim> operator <=(const Matrix<_T, Dim>&) const;
-    template<class _T>
-    Matrix<bool, Dim> operator >=(const Matrix<_T, Dim>&) const;
-    template<class _T>
-    Matrix<bool, Dim> operator <(const Matrix<_T, Dim>&) const;
-    template<class _T>
-    Matrix<bool, Dim> operator >(const Matrix<_T, Dim>&) const;
+    self& assign(const Mask<Dim>& mask, const Matrix<_T, Dim>& src);
 
     template<class _T>
     bool operator ==(const Matrix<_T, Dim>&) const;
@@ -333,7 +393,8 @@ public:
     _Ty max() const;
     _Ty min() const;
 
-    template<class _ResTy = _Ty>
+    /*16-bit floats are summed (and averaged) in float.*/
+    template<class _ResTy = internal::compute_t<_Ty>>
     _ResTy sum() const;
 
     template<class _Tp = _Ty, std::enable_if_t<std::is_integral_v<_Tp>, size_t> _ = 0>
@@ -341,7 +402,7 @@ public:
     template<class _Tp = _Ty, std::enable_if_t<!std::is_integral_v<_Tp>, size_t> _ = 0>
     _Tp mean() const;
 
-    template<class _Tp = _Ty, std::enable_if_t<std::is_arithmetic_v<_Tp>, size_t> _ = 0>
+    template<class _Tp = _Ty, std::enable_if_t<std::is_arithmetic_v<_Tp> || internal::is_half_v<_Tp>, size_t> _ = 0>
     size_t count_nonzero() const;
 
     size_t count(const _Ty& val) const;
@@ -351,12 +412,60 @@ public:
     template<class _Other, size_t _N>
     friend class Matrix;
 
+    template<class _Other, size_t _N>
+    friend struct internal::expr_leaf;
+
+    template<class _Other, size_t _R, size_t _C>
+    friend class SMatrix;
+
+    template<class _Other, size_t _N>
+    friend class MatRef;
+
     template<class ...Types, std::enable_if_t<(sizeof...(Types) == Dim), size_t> _ = 0>
     static self zeros(Types ...sizes);
     template<class ...Types, std::enable_if_t<(sizeof...(Types) == Dim), size_t> _ = 0>
     static self ones(Types ...sizes);
     template<_MAT_DIM_RESTRICT(_N == 2)>
     static self eye(size_t siz);
+
+    /*
+        matrix over the contents of a file, starting at byte offset, without
+        reading it. The mapping lives as long as any matrix or view of it.
+    */
+    static self map_file(const std::string& path, const shape_t& shape, MapMode mode = MAP_MODE_READ, size_t offset = 0);
+
+    /*
+        paging hints, only meaningful for file-backed matrices: will_need starts
+        reading the elements in the background, dont_need lets them be dropped
+        from memory (they are read back from the file on the next access).
+    */
+    void will_need() const;
+    void dont_need() const;
+
+    /*write in the numpy .npy format, views are streamed without a copy of the whole matrix.*/
+    void save(const std::string& path) const;
+    void save(std::ostream& out) const;
+
+    /*read a .npy file written with the same element type and dimension.*/
+    static self load(const std::string& path);
+    static self load(std::istream& in);
+
+    /*
+        parse rows of delimited numbers, one matrix row per non-blank line.
+        A delim of ' ' splits on runs of spaces and tabs. The first skip_rows
+        lines are ignored, and zero extents of shape are inferred from the
+        text. Large inputs are parsed in parallel, in line-aligned chunks.
+    */
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    static self from_text(std::string_view text, char delim = ' ', size_t skip_rows = 0);
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    static self from_text(std::string_view text, const shape_t& shape, char delim = ' ', size_t skip_rows = 0);
+
+    /*from_text over the contents of a file, which is mapped rather than read.*/
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    static self from_csv(const std::string& path, char delim = ',', size_t skip_rows = 0);
+    template<_MAT_DIM_RESTRICT(_N == 2)>
+    static self from_csv(const std::string& path, const shape_t& shape, char delim = ',', size_t skip_rows = 0);
     template<class Rand, class ...Types, std::enable_if_t<(sizeof...(Types) == Dim), size_t> _ = 0>
     static self random(Rand destri, Types ...sizes); 
 
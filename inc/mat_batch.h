@@ -0,0 +1,83 @@
+#pragma once
+
+#include "mat.h"
+#include "mat_ops.h"
+
+namespace zmat{
+
+namespace internal{
+
+/*batch, row and column steps of a bmm operand, a 2-D one is the same matrix for every entry.*/
+template<class _Ty, size_t Dim>
+shape_type<3> bmm_steps(const Matrix<_Ty, Dim>& m){
+    if constexpr(Dim == 2)
+        return {0, m.step(0), m.step(1)};
+    else
+        return {m.step(0), m.step(1), m.step(2)};
+}
+
+/*rows and columns of a bmm operand.*/
+template<class _Ty, size_t Dim>
+shape_type<2> bmm_shape(const Matrix<_Ty, Dim>& m){
+    return {m.size(Dim - 2), m.size(Dim - 1)};
+}
+
+template<class _Ty, size_t _Da, size_t _Db>
+size_t bmm_check(const Matrix<_Ty, _Da>& a, const Matrix<_Ty, _Db>& b){
+    static_assert(std::is_arithmetic_v<_Ty> || is_half_v<_Ty>, "bmm only supports arithmetic types");
+    static_assert((_Da == 2 || _Da == 3) && (_Db == 2 || _Db == 3) && (_Da == 3 || _Db == 3),
+                  "bmm takes stacks of matrices (3-D), one of the operands may be a single 2-D matrix");
+
+    if(!a.is_valid() || !b.is_valid())
+        throw zutil::error_invalid_use();
+    if constexpr(_Da == 3 && _Db == 3){
+        if(a.size(0) != b.size(0))
+            throw std::invalid_argument(zutil::as_str("batch size mismatch: ", a.size(0), " and ", b.size(0)));
+    }
+    if(bmm_shape(a)[1] != bmm_shape(b)[0])
+        throw std::invalid_argument("shape mismatch");
+    return _Da == 3? a.size(0): b.size(0);
+}
+
+/*c[i] += a[i] * b[i], c already checked against the operands.*/
+template<class _Ty, size_t _Da, size_t _Db>
+void bmm_run(const Matrix<_Ty, _Da>& a, const Matrix<_Ty, _Db>& b, Matrix<_Ty, 3>& c){
+    auto sa = bmm_steps(a), sb = bmm_steps(b), sc = bmm_steps(c);
+    gemm_batched(c.size(0), a.raw_begin(), b.raw_begin(), c.raw_begin(),
+                 c.size(1), bmm_shape(a)[1], c.size(2),
+                 sa[0], sa[1], sa[2], sb[0], sb[1], sb[2], sc[0], sc[1], sc[2]);
+}
+
+} // namespace internal
+
+/*
+    Batched matrix product, c[i] = a[i] * b[i] for every entry i of the stacks.
+    Either operand may be a 2-D matrix instead, which multiplies every entry
+    of the other one. Operands can be strided views (e.g. from permute), c
+    is written in place, so it has to have the result shape and must not
+    overlap a or b. See internal::gemm_batched for how the work is spread.
+*/
+template<class _Ty, size_t _Da, size_t _Db>
+void bmm(const Matrix<_Ty, _Da>& a, const Matrix<_Ty, _Db>& b, Matrix<_Ty, 3>& c){
+    size_t batch = internal::bmm_check(a, b);
+    if(!c.is_valid())
+        throw zutil::error_invalid_use();
+    if(c.size(0) != batch || c.size(1) != internal::bmm_shape(a)[0] || c.size(2) != internal::bmm_shape(b)[1])
+        throw std::invalid_argument("shape mismatch");
+    if(internal::mat_overlap(c, a) || internal::mat_overlap(c, b)
+        || c.raw_begin() == a.raw_begin() || c.raw_begin() == b.raw_begin())
+        throw std::invalid_argument("the result overlaps an operand");
+
+    c <<= _Ty(0);
+    internal::bmm_run(a, b, c);
+}
+
+template<class _Ty, size_t _Da, size_t _Db>
+Matrix<_Ty, 3> bmm(const Matrix<_Ty, _Da>& a, const Matrix<_Ty, _Db>& b){
+    size_t batch = internal::bmm_check(a, b);
+    Matrix<_Ty, 3> c({batch, internal::bmm_shape(a)[0], internal::bmm_shape(b)[1]});
+    internal::bmm_run(a, b, c);
+    return c;
+}
+
+} // namespace zmat
@@ -0,0 +1,585 @@
+#pragma once
+
+#include "mat.h"
+#include "kernel/simd.h"
+#include <functional>
+#include <algorithm>
+
+namespace zmat{
+
+namespace internal{
+
+/*
+    Cursors walk one row of an expression (or the whole range when every
+    operand is continuous). operator[] of a binary cursor computes a single
+    element, so a full expression tree is evaluated in one fused loop.
+*/
+template<class _Ty, bool _Unit>
+struct leaf_cursor{
+    const _Ty* ptr;
+    size_t step;
+
+    const _Ty& operator[](size_t j) const{
+        if constexpr(_Unit)
+            return ptr[j];
+        else
+            return ptr[j * step];
+    }
+};
+
+template<class _Ty>
+struct scalar_cursor{
+    _Ty val;
+
+    const _Ty& operator[](size_t) const{
+        return val;
+    }
+};
+
+template<class _Op, class _C1, class _C2>
+struct binary_cursor{
+    _C1 l;
+    _C2 r;
+
+    auto operator[](size_t j) const{
+        return _Op()(l[j], r[j]);
+    }
+};
+
+/*leaf of an expression: a matrix or view, sharing its data.*/
+template<class _Ty, size_t Dim>
+struct expr_leaf{
+    using value_type = _Ty;
+    static constexpr size_t dim = Dim;
+
+    const _Ty* ptr;
+    shape_type<Dim> sizes, steps;
+    data_manager raw;
+    bool continuous;
+
+    expr_leaf(const Matrix<_Ty, Dim>& mat):
+    ptr(mat.start_ptr), sizes(mat._sizes), steps(mat._steps), raw(mat._raw_data),
+    continuous(mat.is_continuous()){
+        if(!mat.is_valid())
+            throw zutil::error_invalid_use();
+    }
+
+    const shape_type<Dim>& shape() const{
+        return sizes;
+    }
+
+    bool is_continuous() const{
+        return continuous;
+    }
+
+    leaf_cursor<_Ty, true> flat() const{
+        return {ptr, 1};
+    }
+
+    /*true if the last dimension is contiguous, so row<true>() can be used.*/
+    bool unit_rows() const{
+        return steps[Dim - 1] == 1;
+    }
+
+    /*idx is an index of the whole expression, whose trailing Dim entries address this operand.*/
+    template<bool _Unit = false, size_t D>
+    leaf_cursor<_Ty, _Unit> row(const shape_type<D>& idx) const{
+        const _Ty* p = ptr;
+        for(size_t i = 0; i + 1 < Dim; ++i)
+            p += idx[D - Dim + i] * steps[i];
+        return {p, steps[Dim - 1]};
+    }
+
+    /*
+        read as the expression shape: size-1 axes are repeated with a zero step,
+        missing leading axes need nothing since row() ignores them.
+    */
+    template<size_t D>
+    void broadcast(const shape_type<D>& shape){
+        bool same = true;
+        for(size_t i = 0; i < Dim; ++i){
+            if(sizes[i] != shape[D - Dim + i]){
+                sizes[i] = shape[D - Dim + i];
+                steps[i] = 0;
+                same = false;
+            }
+        }
+        for(size_t i = 0; i < D - Dim; ++i)
+            same = same && shape[i] == 1;
+        continuous = continuous && same;
+    }
+
+    /*true if writing the destination in order may clobber this operand before it is read.*/
+    template<size_t D>
+    bool aliases(const MatrixData<void>* data, const void* dst, const shape_type<D>& dst_steps) const{
+        if(raw.get() != data)
+            return false;
+        if constexpr(D == Dim)
+            return static_cast<const void*>(ptr) != dst || steps != dst_steps;
+        else
+            return true;
+    }
+};
+
+template<class _Ty>
+struct expr_scalar{
+    using value_type = _Ty;
+    static constexpr size_t dim = 0;
+
+    _Ty val;
+
+    bool is_continuous() const{
+        return true;
+    }
+
+    scalar_cursor<_Ty> flat() const{
+        return {val};
+    }
+
+    bool unit_rows() const{
+        return true;
+    }
+
+    template<bool _Unit = false, class _Idx>
+    scalar_cursor<_Ty> row(const _Idx&) const{
+        return {val};
+    }
+
+    template<class _Shape>
+    void broadcast(const _Shape&){}
+
+    template<class ..._Args>
+    bool aliases(const _Args& ...) const{
+        return false;
+    }
+};
+
+template<class _Ty, size_t Dim>
+expr_leaf<_Ty, Dim> make_operand(const Matrix<_Ty, Dim>& mat){
+    return expr_leaf<_Ty, Dim>(mat);
+}
+
+template<class _Op, class _L, class _R>
+const MatExpr<_Op, _L, _R>& make_operand(const MatExpr<_Op, _L, _R>& expr){
+    return expr;
+}
+
+template<class _Ty, std::enable_if_t<!is_mat_like_v<_Ty>, size_t> _ = 0>
+expr_scalar<std::decay_t<const _Ty&>> make_operand(const _Ty& val){
+    return {val};
+}
+
+template<class _Op, class _T1, class _T2>
+auto make_expr(const _T1& a, const _T2& b){
+    auto l = make_operand(a);
+    auto r = make_operand(b);
+    return MatExpr<_Op, decltype(l), decltype(r)>(l, r);
+}
+
+template<class _Ty, size_t Dim>
+const Matrix<_Ty, Dim>& evaluate(const Matrix<_Ty, Dim>& mat){
+    return mat;
+}
+
+template<class _Op, class _L, class _R>
+auto evaluate(const MatExpr<_Op, _L, _R>& expr){
+    return expr.eval();
+}
+
+/*write every element of expr into dst, which has the same shape.*/
+template<class _Ty, size_t Dim, class _Expr>
+void expr_assign(Matrix<_Ty, Dim>& dst, const _Expr& expr){
+    constexpr bool half = is_half_v<_Ty> || is_half_v<typename _Expr::value_type>;
+    _Ty* d = dst.raw_begin();
+    size_t n = dst.size();
+    size_t nth = parallel_threads(n);
+
+    if(dst.is_continuous() && expr.is_continuous()){
+        auto cur = expr.flat();
+        if constexpr(half){
+            parallel_for_range(n, nth, [&](size_t l, size_t r){
+                simd::simd_for<true>(r - l, [=](size_t i){ d[l + i] = cur[l + i]; });
+            });
+        }else if(nth > 1){
+            #pragma omp parallel for simd num_threads(nth)
+            for(size_t i = 0; i < n; ++i)
+                d[i] = cur[i];
+        }else{
+            #pragma omp simd
+            for(size_t i = 0; i < n; ++i)
+                d[i] = cur[i];
+        }
+        return;
+    }
+
+    const auto& shape = expr.shape();
+    size_t len = shape[Dim - 1], step = dst.step(Dim - 1);
+    size_t rows = n / len;
+    bool unit = step == 1 && expr.unit_rows();
+
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(size_t r = 0; r < rows; ++r){
+        shape_type<Dim> idx{};
+        _Ty* dp = d;
+        for(size_t i = Dim - 1, rem = r; i-- > 0;){
+            idx[i] = rem % shape[i];
+            rem /= shape[i];
+            dp += idx[i] * dst.step(i);
+        }
+        if(unit){
+            auto cur = expr.template row<true>(idx);
+            simd::simd_for<half>(len, [=](size_t j){ dp[j] = cur[j]; });
+        }else{
+            auto cur = expr.row(idx);
+            for(size_t j = 0; j < len; ++j)
+                dp[j * step] = cur[j];
+        }
+    }
+}
+
+/*reduction steps for expr_reduce, each folds its right operand into acc.*/
+struct reduce_sum{
+    template<class _Acc, class _T>
+    void operator()(_Acc& acc, const _T& val) const{
+        acc += val;
+    }
+};
+
+struct reduce_max{
+    template<class _Acc, class _T>
+    void operator()(_Acc& acc, const _T& val) const{
+        if(acc < val) acc = val;
+    }
+};
+
+struct reduce_min{
+    template<class _Acc, class _T>
+    void operator()(_Acc& acc, const _T& val) const{
+        if(val < acc) acc = val;
+    }
+};
+
+template<class _Fn>
+struct reduce_count{
+    _Fn cond;
+
+    template<class _T>
+    void operator()(size_t& acc, const _T& val) const{
+        acc += static_cast<bool>(cond(val));
+    }
+};
+
+/*
+    Reduce every element of expr in parallel. fn(acc, ele) folds an element
+    into an accumulator and comb(acc, other) merges two of them; init must be
+    an identity for both. Threads take contiguous ranges (or row ranges) and
+    their partial results are merged pairwise in order, so comb only needs
+    to be associative.
+*/
+template<class _Acc, class _Expr, class _Fn, class _Comb>
+_Acc expr_reduce(const _Expr& expr, const _Acc& init, _Fn fn, _Comb comb){
+    constexpr size_t Dim = _Expr::dim;
+    const auto& shape = expr.shape();
+    size_t n = 1;
+    for(auto i: shape)
+        n *= i;
+    size_t nth = parallel_threads(n);
+    std::vector<_Acc> part(nth, init);
+
+    if(expr.is_continuous()){
+        auto cur = expr.flat();
+        #pragma omp parallel for num_threads(nth) if(nth > 1) schedule(static)
+        for(size_t t = 0; t < nth; ++t){
+            size_t l = n * t / nth, r = n * (t + 1) / nth;
+            part[t] = simd::reduce(cur, l, r, init, fn, comb);
+        }
+    }else{
+        size_t len = shape[Dim - 1], rows = n / len;
+        bool unit = expr.unit_rows();
+        nth = std::min(nth, rows);
+
+        #pragma omp parallel for num_threads(nth) if(nth > 1) schedule(static)
+        for(size_t t = 0; t < nth; ++t){
+            size_t l = rows * t / nth, r = rows * (t + 1) / nth;
+            shape_type<Dim> idx{};
+            for(size_t i = Dim - 1, rem = l; i-- > 0;){
+                idx[i] = rem % shape[i];
+                rem /= shape[i];
+            }
+            for(size_t k = l; k < r; ++k){
+                if(unit)
+                    comb(part[t], simd::reduce(expr.template row<true>(idx), 0, len, init, fn, comb));
+                else
+                    comb(part[t], simd::reduce(expr.row(idx), 0, len, init, fn, comb));
+                for(size_t i = Dim - 1; i > 0 && ++idx[i - 1] == shape[i - 1]; --i)
+                    idx[i - 1] = 0;
+            }
+        }
+    }
+
+    for(size_t w = 1; w < nth; w *= 2)
+        for(size_t t = 0; t + w < nth; t += 2 * w)
+            comb(part[t], part[t + w]);
+    return part[0];
+}
+
+/*
+    shape of an elementwise result, numpy style: shapes are aligned from the
+    right, and along each axis the sizes agree or one of them is 1.
+*/
+template<size_t D, size_t D1, size_t D2>
+shape_type<D> broadcast_shape(const shape_type<D1>& a, const shape_type<D2>& b){
+    shape_type<D> res{};
+    for(size_t k = 0; k < D; ++k){
+        size_t x = k + D1 >= D? a[k + D1 - D]: 1;
+        size_t y = k + D2 >= D? b[k + D2 - D]: 1;
+        if(x != y && x != 1 && y != 1)
+            throw std::invalid_argument("shape mismatch");
+        res[k] = x == 1? y: x;
+    }
+    return res;
+}
+
+template<class _L, class _R>
+constexpr bool is_ew_operands_v = is_mat_like_v<_L> || is_mat_like_v<_R>;
+
+template<class _L, class _R>
+constexpr bool is_scaling_operands_v = is_mat_like_v<_L> != is_mat_like_v<_R>;
+
+template<class _L, class _R>
+constexpr bool is_lazy_product_v = is_mat_like_v<_L> && is_mat_like_v<_R>
+                                    && (is_mat_expr_v<_L> || is_mat_expr_v<_R>);
+
+/*
+    element type an expression is stored as: the result of _Op, except that a
+    16-bit float combined with itself or with a scalar stays 16-bit. The
+    cursors still compute in float, only the stored result is rounded.
+*/
+template<class _Op, class _L, class _R>
+struct expr_value{
+    using _T1 = typename _L::value_type;
+    using _T2 = typename _R::value_type;
+    using type = std::conditional_t<is_half_v<_T1> && (std::is_same_v<_T1, _T2> || _R::dim == 0), _T1,
+                 std::conditional_t<is_half_v<_T2> && _L::dim == 0, _T2,
+                 std::decay_t<decltype(_Op()(std::declval<_T1>(), std::declval<_T2>()))>>>;
+};
+
+} // namespace internal
+
+/*
+    Unevaluated elementwise expression. Operands are held by value (matrix
+    operands keep their data alive), and the whole tree is computed in a single
+    pass when it is converted to a Matrix, assigned with <<= or reduced.
+    Operands of different shapes are broadcast against each other, see
+    internal::broadcast_shape; repeated elements are read through zero steps,
+    never copied.
+*/
+template<class _Op, class _L, class _R>
+class MatExpr{
+    _L l;
+    _R r;
+
+public:
+    using value_type = typename internal::expr_value<_Op, _L, _R>::type;
+    static constexpr size_t dim = std::max(_L::dim, _R::dim);
+    using shape_t = shape_type<dim>;
+
+private:
+    shape_t _shape;
+
+public:
+    MatExpr(const _L& l, const _R& r): l(l), r(r){
+        if constexpr(_L::dim == 0){
+            _shape = r.shape();
+        }else if constexpr(_R::dim == 0){
+            _shape = l.shape();
+        }else{
+            _shape = internal::broadcast_shape<dim>(l.shape(), r.shape());
+            this->l.broadcast(_shape);
+            this->r.broadcast(_shape);
+        }
+    }
+
+    const shape_t& shape() const{
+        return _shape;
+    }
+
+    template<size_t D>
+    void broadcast(const shape_type<D>& shape){
+        for(size_t i = 0; i < dim; ++i)
+            _shape[i] = shape[D - dim + i];
+        l.broadcast(shape);
+        r.broadcast(shape);
+    }
+
+    bool is_continuous() const{
+        return l.is_continuous() && r.is_continuous();
+    }
+
+    auto flat() const{
+        return internal::binary_cursor<_Op, decltype(l.flat()), decltype(r.flat())>{l.flat(), r.flat()};
+    }
+
+    bool unit_rows() const{
+        return l.unit_rows() && r.unit_rows();
+    }
+
+    template<bool _Unit = false, size_t D = dim>
+    auto row(const shape_type<D>& idx) const{
+        using _C1 = decltype(l.template row<_Unit>(idx));
+        using _C2 = decltype(r.template row<_Unit>(idx));
+        return internal::binary_cursor<_Op, _C1, _C2>{l.template row<_Unit>(idx), r.template row<_Unit>(idx)};
+    }
+
+    template<class ..._Args>
+    bool aliases(const _Args& ...args) const{
+        return l.aliases(args...) || r.aliases(args...);
+    }
+
+    size_t size(size_t index) const{
+        return shape()[index];
+    }
+
+    size_t size() const{
+        size_t tot = 1;
+        for(auto i: shape())
+            tot *= i;
+        return tot;
+    }
+
+    constexpr size_t dims() const{
+        return dim;
+    }
+
+    Matrix<value_type, dim> eval() const{
+        return Matrix<value_type, dim>(*this);
+    }
+
+    template<class _T, std::enable_if_t<is_mat_like_v<_T>, size_t> _ = 0>
+    auto mul(const _T& b) const{
+        return internal::make_expr<std::multiplies<>>(*this, b);
+    }
+
+    template<class _ResTy = internal::compute_t<value_type>>
+    _ResTy sum() const{
+        return internal::expr_reduce(*this, _ResTy(), internal::reduce_sum(), internal::reduce_sum());
+    }
+
+    value_type max() const{
+        using acc_t = internal::compute_t<value_type>;
+        return internal::expr_reduce(*this, acc_t(row(shape_t{})[0]), internal::reduce_max(), internal::reduce_max());
+    }
+
+    value_type min() const{
+        using acc_t = internal::compute_t<value_type>;
+        return internal::expr_reduce(*this, acc_t(row(shape_t{})[0]), internal::reduce_min(), internal::reduce_min());
+    }
+
+    template<class _Tp = value_type>
+    auto mean() const{
+        using res_t = std::conditional_t<std::is_integral_v<_Tp>, double, _Tp>;
+        using acc_t = internal::compute_t<res_t>;
+        return static_cast<res_t>(static_cast<acc_t>(sum()) / static_cast<acc_t>(size()));
+    }
+
+    template<class _Fn, std::enable_if_t<std::is_invocable_r_v<bool, _Fn, const value_type&>, size_t> _ = 0>
+    size_t count_if(_Fn cond) const{
+        return internal::expr_reduce(*this, size_t(0), internal::reduce_count<_Fn>{cond}, internal::reduce_sum());
+    }
+
+    template<class _Tp = value_type, std::enable_if_t<std::is_arithmetic_v<_Tp> || internal::is_half_v<_Tp>, size_t> _ = 0>
+    size_t count_nonzero() const{
+        return count_if([](const value_type& ele){return ele != static_cast<_Tp>(0);});
+    }
+};
+
+template<class _Ty, size_t Dim>
+template<class _Op, class _L, class _R>
+Matrix<_Ty, Dim>::Matrix(const MatExpr<_Op, _L, _R>& expr){
+    static_assert(MatExpr<_Op, _L, _R>::dim == Dim, "Dimension mismatch");
+
+    reset();
+    init_uninit(expr.shape().begin());
+    internal::expr_assign(*this, expr);
+}
+
+template<class _Ty, size_t Dim>
+template<class _Op, class _L, class _R>
+auto Matrix<_Ty, Dim>::operator <<=(const MatExpr<_Op, _L, _R>& expr)-> self&{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    if(_sizes != expr.shape())
+        throw std::invalid_argument("shape mismatch");
+
+    if(expr.aliases(_raw_data.get(), start_ptr, _steps))
+        return *this <<= expr.eval();
+
+    internal::expr_assign(*this, expr);
+    return *this;
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, std::enable_if_t<is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>::mul(const _T& b) const{
+    return internal::make_expr<std::multiplies<>>(*this, b);
+}
+
+template<class _L, class _R, std::enable_if_t<internal::is_ew_operands_v<_L, _R>, size_t> _ = 0>
+auto operator +(const _L& a, const _R& b){
+    return internal::make_expr<std::plus<>>(a, b);
+}
+
+template<class _L, class _R, std::enable_if_t<internal::is_ew_operands_v<_L, _R>, size_t> _ = 0>
+auto operator -(const _L& a, const _R& b){
+    return internal::make_expr<std::minus<>>(a, b);
+}
+
+template<class _L, class _R, std::enable_if_t<internal::is_ew_operands_v<_L, _R>, size_t> _ = 0>
+auto operator /(const _L& a, const _R& b){
+    return internal::make_expr<std::divides<>>(a, b);
+}
+
+/*scaling by a scalar is elementwise, a product of two matrices is not.*/
+template<class _L, class _R, std::enable_if_t<internal::is_scaling_operands_v<_L, _R>, size_t> _ = 0>
+auto operator *(const _L& a, const _R& b){
+    return internal::make_expr<std::multiplies<>>(a, b);
+}
+
+/*operations that need a materialized matrix evaluate the expression operands first.*/
+#define _MAT_EXPR_EVAL_OP(op)\
+template<class _L, class _R, std::enable_if_t<internal::is_lazy_product_v<_L, _R>, size_t> _ = 0>\
+auto operator op(const _L& a, const _R& b){\
+    return internal::evaluate(a) op internal::evaluate(b);\
+}
+
+_MAT_EXPR_EVAL_OP(*)
+_MAT_EXPR_EVAL_OP(==)
+_MAT_EXPR_EVAL_OP(!=)
+_MAT_EXPR_EVAL_OP(<)
+_MAT_EXPR_EVAL_OP(<=)
+_MAT_EXPR_EVAL_OP(>)
+_MAT_EXPR_EVAL_OP(>=)
+
+#undef _MAT_EXPR_EVAL_OP
+
+/*an expression compared with a scalar is evaluated first, then compared like a matrix.*/
+#define _MAT_EXPR_SCALAR_CMP(op)\
+template<class _L, class _R, std::enable_if_t<is_mat_expr_v<_L> && !is_mat_like_v<_R>, size_t> _ = 0>\
+auto operator op(const _L& a, const _R& val){\
+    return a.eval() op val;\
+}
+
+_MAT_EXPR_SCALAR_CMP(<)
+_MAT_EXPR_SCALAR_CMP(<=)
+_MAT_EXPR_SCALAR_CMP(>)
+_MAT_EXPR_SCALAR_CMP(>=)
+
+#undef _MAT_EXPR_SCALAR_CMP
+
+template<class _Op, class _L, class _R>
+std::ostream& operator <<(std::ostream& out, const MatExpr<_Op, _L, _R>& expr){
+    expr.eval().print(out);
+    return out;
+}
+
+} // namespace zmat
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mat.h"
+#include "kernel/simd.h"
 #include <random>
 
 namespace zmat{
@@ -11,13 +12,10 @@ _ResTy Matrix<_Ty, Dim>::accumulate(_Fn func, _ResTy&& res) const{
     if(!is_valid()){
         throw zutil::error_invalid_use();
     }
-    if(is_continuous()){
-        for(auto it = raw_begin(); it != raw_end(); ++it)
-            func(*it, res);
-    }else{
-        for(auto it = begin(); it != end(); ++it)
-            func(*it, res);
-    }
+    internal::stride_walk(_sizes, 1, [&func, &res](size_t n, auto src){
+        for(size_t j = 0; j < n; ++j)
+            func(src[j], res);
+    }, internal::walk_of(*this));
     return res;
 }
 
@@ -29,37 +27,38 @@ _ResTy Matrix<_Ty, Dim>::accumulate(_Fn func) const{
     }
 
     _ResTy res = front();
+    bool first = true;
 
-    if(is_continuous()){
-        for(auto it = raw_begin() + 1; it != raw_end(); ++it)
-            func(*it, res);
-    }else{
-        for(auto it = begin() + 1; it != end(); ++it)
-            func(*it, res);
-    }
+    internal::stride_walk(_sizes, 1, [&func, &res, &first](size_t n, auto src){
+        for(size_t j = first; j < n; ++j)
+            func(src[j], res);
+        first = false;
+    }, internal::walk_of(*this));
     return res;
 }
 
 template<class _Ty, size_t Dim>
 auto Matrix<_Ty, Dim>::max() const-> _Ty{
-    return accumulate<_Ty>([](const _Ty& ele, _Ty& mx){
-        if(mx < ele) mx = ele;
-    });
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    using acc_t = internal::compute_t<_Ty>;
+    return internal::expr_reduce(internal::make_operand(*this), acc_t(front()), internal::reduce_max(), internal::reduce_max());
 }
 
 template<class _Ty, size_t Dim>
 auto Matrix<_Ty, Dim>::min() const-> _Ty{
-    return accumulate<_Ty>([](const _Ty& ele, _Ty& mn){
-        if(ele < mn) mn = ele;
-    });  
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    using acc_t = internal::compute_t<_Ty>;
+    return internal::expr_reduce(internal::make_operand(*this), acc_t(front()), internal::reduce_min(), internal::reduce_min());
 }
 
 template<class _Ty, size_t Dim>
 template<class _ResTy>
 auto Matrix<_Ty, Dim>::sum() const-> _ResTy{
-    return accumulate<_ResTy>([](const _Ty& ele, _ResTy& sum){
-        sum += ele;
-    });
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    return internal::expr_reduce(internal::make_operand(*this), _ResTy(), internal::reduce_sum(), internal::reduce_sum());
 }
 
 template<class _Ty, size_t Dim>
@@ -71,15 +70,16 @@ auto Matrix<_Ty, Dim>::mean() const-> double{
 template<class _Ty, size_t Dim>
 template<class _Tp, std::enable_if_t<!std::is_integral_v<_Tp>, size_t> _>
 auto Matrix<_Ty, Dim>::mean() const-> _Tp{
-    return static_cast<_Tp>(sum())/static_cast<_Tp>(size());
+    using acc_t = internal::compute_t<_Tp>;
+    return static_cast<_Tp>(static_cast<acc_t>(sum())/static_cast<acc_t>(size()));
 }
 
 template<class _Ty, size_t Dim>
 template<class _Fn, std::enable_if_t<std::is_invocable_r_v<bool, _Fn, const _Ty&>, size_t> _>
 auto Matrix<_Ty, Dim>::count_if(_Fn cond) const -> size_t{
-    return accumulate<size_t>([&cond](const _Ty& ele, size_t& res){
-        res += cond(ele);
-    }, 0);
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    return internal::expr_reduce(internal::make_operand(*this), size_t(0), internal::reduce_count<_Fn>{cond}, internal::reduce_sum());
 }
 
 template<class _Ty, size_t Dim>
@@ -88,14 +88,14 @@ auto Matrix<_Ty, Dim>::count(const _Ty& val) const -> size_t{
 }
 
 template<class _Ty, size_t Dim>
-template<class _Tp, std::enable_if_t<std::is_arithmetic_v<_Tp>, size_t> _>
+template<class _Tp, std::enable_if_t<std::is_arithmetic_v<_Tp> || internal::is_half_v<_Tp>, size_t> _>
 auto Matrix<_Ty, Dim>::count_nonzero() const -> size_t{
     return count_if([](const _Ty& ele){return ele != static_cast<_Tp>(0);});
 }
 
 template<class _Ty, size_t Dim>
 void Matrix<_Ty, Dim>::fill(const _Ty& val){
-    *this <= val;
+    *this <<= val;
 }
 
 template<class _Ty, size_t Dim>
@@ -108,18 +108,41 @@ auto Matrix<_Ty, Dim>::maps(_Fn mapper) const->Matrix<_ResTy, Dim>{
     return res;
 }
 
+template<class _Ty, size_t Dim>
+template<class _U>
+auto Matrix<_Ty, Dim>::astype(int mode) const-> Matrix<_U, Dim>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+
+    Matrix<_U, Dim> res;
+    res.init_uninit(_sizes.begin());
+
+    auto run = [&](auto round, auto saturate){
+        internal::stride_walk(_sizes, internal::parallel_threads(size()), [](size_t n, auto dst, auto src){
+            simd::convert<decltype(round)::value, decltype(saturate)::value>(src.ptr, src.step, dst.ptr, dst.step, n);
+        }, internal::walk_of(res), internal::walk_of(*this));
+    };
+    bool round = mode & CAST_ROUND, saturate = mode & CAST_SATURATE;
+    if(round && saturate)
+        run(std::true_type(), std::true_type());
+    else if(round)
+        run(std::true_type(), std::false_type());
+    else if(saturate)
+        run(std::false_type(), std::true_type());
+    else
+        run(std::false_type(), std::false_type());
+    return res;
+}
+
 template<class _Ty, size_t Dim>
 template<class _Fn, std::enable_if_t<std::is_invocable_v<_Fn, _Ty&>, size_t> _>
 void Matrix<_Ty, Dim>::apply(_Fn op){
     if(!is_valid())
         throw zutil::error_invalid_use();
-    if(is_continuous()){
-        for(auto it = raw_begin(); it != raw_end(); ++it)
-            op(*it);
-    }else{
-        for(auto it = begin(); it != end(); ++it)
-            op(*it);
-    }
+    internal::stride_walk(_sizes, 1, [&op](size_t n, auto dst){
+        for(size_t j = 0; j < n; ++j)
+            op(dst[j]);
+    }, internal::walk_of(*this));
 }
 
 template<class _Ty, size_t Dim>
@@ -145,7 +168,7 @@ auto Matrix<_Ty, Dim>::eye(size_t siz)-> self{
     pointer ptr = res.start_ptr;
     for(size_t i = 0; i < siz; ++i){
         *ptr = 1;
-        ptr += siz + 1;
+        ptr += res.step(0) + 1;
     }
     return res;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "mat.h"
+#include "kernel/transpose.h"
+#include <utility>
 
 namespace zmat{
 
@@ -19,11 +21,49 @@ void set_size_and_step(std::array<size_t, Dim>& sizes, std::array<size_t, Dim>&
         steps[i - 1] = steps[i] * sizes[i];
 }
 
+/*whether Axes is a permutation of 0 .. Dim - 1.*/
+template<size_t Dim, size_t ...Axes>
+constexpr bool is_axes_permutation(){
+    if(sizeof...(Axes) != Dim)
+        return false;
+    bool seen[Dim] = {};
+    for(size_t axis: {Axes...}){
+        if(axis >= Dim || seen[axis])
+            return false;
+        seen[axis] = true;
+    }
+    return true;
+}
+
+template<class _Ty, size_t Dim>
+shape_type<Dim> shape_of(const Matrix<_Ty, Dim>& mat){
+    shape_type<Dim> res;
+    for(size_t i = 0; i < Dim; ++i)
+        res[i] = mat.size(i);
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+walk_operand<_Ty, Dim> walk_of(Matrix<_Ty, Dim>& mat){
+    walk_operand<_Ty, Dim> res{mat.raw_begin(), {}};
+    for(size_t i = 0; i < Dim; ++i)
+        res.steps[i] = mat.step(i);
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+walk_operand<const _Ty, Dim> walk_of(const Matrix<_Ty, Dim>& mat){
+    walk_operand<const _Ty, Dim> res{mat.raw_begin(), {}};
+    for(size_t i = 0; i < Dim; ++i)
+        res.steps[i] = mat.step(i);
+    return res;
+}
+
 template<class _SrcIt, class _Ty>
 void copy_construct_uninit(_Ty* _begin, _SrcIt _src, size_t size){
     std::allocator<_Ty> alloc;
     for(size_t i = 0; i < size; ++i){
-        alloc.construct(_begin, *_src);
+        std::construct_at(_begin, *_src);
         ++_begin;
         ++_src;
     }
@@ -73,8 +113,8 @@ shape_type<Dim> set_view_config(_It rng_it, const size_t siz, const shape_type<D
 
 
 template<class _Ty, size_t Dim>
-template<class _It, class ..._Args>
-void Matrix<_Ty, Dim>::init_shape(_It it, _Args ...args){
+template<class _It>
+void Matrix<_Ty, Dim>::init_layout(_It it){
 
     auto tmp = it;
     for(size_t i = 0; i < Dim; ++i){
@@ -83,11 +123,36 @@ void Matrix<_Ty, Dim>::init_shape(_It it, _Args ...args){
     }
 
     internal::set_size_and_step(_sizes, _steps, it);
-    size_t siz = size();
+    if constexpr(Dim >= 2){
+        size_t pitch = internal::padded_pitch(_sizes[Dim - 1], sizeof(_Ty));
+        if(pitch != _sizes[Dim - 1]){
+            _steps[Dim - 2] = pitch;
+            for(size_t i = Dim - 2; i > 0; --i)
+                _steps[i - 1] = _steps[i] * _sizes[i];
+        }
+    }
 
-    _raw_data = internal::make_manager<_Ty>(siz, std::forward<_Args>(args)...);
-    start_ptr = reinterpret_cast<_Ty*>(_raw_data->get_data());
     flag = CONTINUOUS_FLAG;
+    recalc_continuous();
+}
+
+template<class _Ty, size_t Dim>
+template<class _It, class ..._Args>
+void Matrix<_Ty, Dim>::init_shape(_It it, _Args ...args){
+    init_layout(it);
+    _raw_data = internal::make_manager<_Ty>(_sizes[0] * _steps[0], std::forward<_Args>(args)...);
+    start_ptr = reinterpret_cast<_Ty*>(_raw_data->get_data());
+}
+
+template<class _Ty, size_t Dim>
+template<class _It>
+void Matrix<_Ty, Dim>::init_uninit(_It it){
+    init_layout(it);
+    if constexpr(std::is_trivially_default_constructible_v<_Ty>)
+        _raw_data = internal::make_manager_uninit<_Ty>(_sizes[0] * _steps[0]);
+    else
+        _raw_data = internal::make_manager<_Ty>(_sizes[0] * _steps[0]);
+    start_ptr = reinterpret_cast<_Ty*>(_raw_data->get_data());
 }
 
 template<class _Ty, size_t Dim>
@@ -107,7 +172,17 @@ template<class _Ty, size_t Dim>
 template<class _It>
 void Matrix<_Ty, Dim>::bind(_It shape, pointer ptr){
     reset();
-    init_shape(shape, ptr, false);
+
+    auto tmp = shape;
+    for(size_t i = 0; i < Dim; ++i){
+        if(*tmp++ == 0)
+            throw std::invalid_argument("matrix size cannot be zero.");
+    }
+
+    internal::set_size_and_step(_sizes, _steps, shape);
+    _raw_data = internal::make_manager<_Ty>(size(), ptr, false);
+    start_ptr = ptr;
+    flag = CONTINUOUS_FLAG;
 }
 
 template<class _Ty, size_t Dim> 
@@ -202,7 +277,6 @@ void Matrix<_Ty, Dim>::create(const std::initializer_list<internal::init_val_bas
         internal::fill_init_value<Dim - 1>(start_ptr + i * _steps[0], _steps.begin() + 1, val);
         ++i;   
     }
-    flag = CONTINUOUS_FLAG;
 }
 
 template<class _Ty, size_t Dim>
@@ -295,7 +369,7 @@ Matrix<_Ty, Dim>::Matrix(pointer ptr, const size_t x){
 template<class _Ty, size_t Dim> 
 template<class _It1, class _It2>
 Matrix<_Ty, Dim>::Matrix(pointer st_ptr,data_manager raw, _It1 shape_it, _It2 step_it):
-_raw_data(raw), start_ptr(st_ptr){
+_raw_data(std::move(raw)), start_ptr(st_ptr){
 
     for(size_t i = 0; i < Dim; ++i){
         _sizes[i] = *shape_it++;
@@ -306,6 +380,47 @@ _raw_data(raw), start_ptr(st_ptr){
     recalc_continuous();
 }
 
+template<class _Ty, size_t Dim> 
+auto Matrix<_Ty, Dim>:: default_format()-> const std::shared_ptr<formatter<_Ty>>&{
+    static const std::shared_ptr<formatter<_Ty>> res = std::make_shared<def_fmt>();
+    return res;
+}
+
+template<class _Ty, size_t Dim> 
+auto Matrix<_Ty, Dim>:: map_file(const std::string& path, const shape_t& shape, MapMode mode, size_t offset)-> self{
+    for(auto siz: shape){
+        if(siz == 0)
+            throw std::invalid_argument("matrix size cannot be zero.");
+    }
+    if(offset % alignof(_Ty) != 0)
+        throw std::invalid_argument("file offset is not aligned for the element type");
+
+    self res;
+    internal::set_size_and_step(res._sizes, res._steps, shape.begin());
+    res._raw_data = std::make_shared<internal::MappedData<_Ty>>(path, res.size(), offset, mode);
+    res.start_ptr = reinterpret_cast<_Ty*>(res._raw_data->get_data());
+    res.flag = CONTINUOUS_FLAG;
+    return res;
+}
+
+template<class _Ty, size_t Dim> 
+void Matrix<_Ty, Dim>:: will_need() const{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    internal::stride_walk(_sizes, 1, [this](size_t n, auto src){
+        _raw_data->advise(src.ptr, ((n - 1) * src.step + 1) * sizeof(_Ty), true);
+    }, internal::walk_of(*this));
+}
+
+template<class _Ty, size_t Dim> 
+void Matrix<_Ty, Dim>:: dont_need() const{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    internal::stride_walk(_sizes, 1, [this](size_t n, auto src){
+        _raw_data->advise(src.ptr, ((n - 1) * src.step + 1) * sizeof(_Ty), false);
+    }, internal::walk_of(*this));
+}
+
 template<class _Ty, size_t Dim> 
 void Matrix<_Ty, Dim>:: reset(){
     _raw_data = nullptr;
@@ -565,18 +680,30 @@ auto Matrix<_Ty, Dim>:: clone() const-> self{
         throw zutil::error_invalid_use();
 
     self res;
+    res.init_layout(_sizes.begin());
+    size_t cap = res._sizes[0] * res._steps[0];
 
-    res.flag = CONTINUOUS_FLAG;
-    internal::set_size_and_step(res._sizes, res._steps, _sizes.begin());
-
-    if(is_continuous()){
-        res._raw_data = internal::make_manager<_Ty>(res.size(), raw_begin());
+    if(is_continuous() && res.is_continuous()){
+        res._raw_data = internal::make_manager<_Ty>(cap, raw_begin());
         res.start_ptr = reinterpret_cast<_Ty*>(res._raw_data->get_data());
-    }else{
-        res._raw_data = internal::make_manager_uninit<_Ty>(res.size());
+    }else if(res.is_continuous() || std::is_trivially_default_constructible_v<_Ty>){
+        /*every element is copy constructed, padding of trivial types may stay raw.*/
+        res._raw_data = internal::make_manager_uninit<_Ty>(cap);
         res.start_ptr = reinterpret_cast<_Ty*>(res._raw_data->get_data());
 
-        internal::copy_construct_uninit(res.start_ptr, begin(), res.size());
+        internal::stride_walk(_sizes, internal::parallel_threads(size()), [](size_t n, auto dst, auto src){
+            if(src.unit()){
+                std::uninitialized_copy_n(src.ptr, n, dst.ptr);
+            }else{
+                for(size_t j = 0; j < n; ++j)
+                    std::construct_at(&dst[j], src[j]);
+            }
+        }, internal::walk_of(res), internal::walk_of(*this));
+    }else{
+        /*padded rows of objects: the padding has to be constructed too.*/
+        res._raw_data = internal::make_manager<_Ty>(cap);
+        res.start_ptr = reinterpret_cast<_Ty*>(res._raw_data->get_data());
+        res <<= *this;
     }
 
     return res;
@@ -589,17 +716,51 @@ void Matrix<_Ty, Dim>::reshape(Types ...args){
 
     if(!is_valid())
         throw zutil::error_invalid_use();
-    if(!is_continuous())
-        throw std::logic_error("cannot reshape a non-continuous matrix");
 
-    size_t sizes[] = {static_cast<size_t>(args)...};
+    shape_t sizes = {static_cast<size_t>(args)...}, steps;
     size_t tot = 1;
     for(auto siz: sizes)
         tot *= siz;
     if(tot != size())
         throw std::invalid_argument("Matrix size cannot change in reshape.");
-    
-    internal::set_size_and_step(_sizes, _steps, sizes);
+    if(!internal::reshape_steps(_sizes.data(), _steps.data(), Dim, sizes.data(), steps.data(), Dim))
+        throw std::logic_error("cannot reshape the matrix without moving its elements, use reshaped()");
+
+    _sizes = sizes;
+    _steps = steps;
+    recalc_continuous();
+}
+
+template<class _Ty, size_t Dim> 
+template<class ...Types>
+auto Matrix<_Ty, Dim>::reshaped(Types ...args)-> Matrix<_Ty, sizeof...(Types)>{
+    return std::as_const(*this).reshaped(args...);
+}
+
+template<class _Ty, size_t Dim> 
+template<class ...Types>
+auto Matrix<_Ty, Dim>::reshaped(Types ...args) const-> const Matrix<_Ty, sizeof...(Types)>{
+    constexpr size_t arg_cnt = sizeof...(Types);
+    static_assert((std::is_convertible_v<Types, size_t> && ...), "Index should be size type.");
+
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+
+    shape_type<arg_cnt> sizes = {static_cast<size_t>(args)...}, steps;
+    size_t tot = 1;
+    for(auto siz: sizes)
+        tot *= siz;
+    if(tot != size())
+        throw std::invalid_argument("Matrix size cannot change in reshape.");
+
+    if(internal::reshape_steps(_sizes.data(), _steps.data(), Dim, sizes.data(), steps.data(), arg_cnt))
+        return Matrix<_Ty, arg_cnt>(start_ptr, _raw_data, sizes.begin(), steps.begin());
+
+    /*no steps walk the elements in this order, they have to be gathered.*/
+    Matrix<_Ty, arg_cnt> res;
+    res.init_uninit(sizes.begin());
+    std::copy(begin(), end(), res.begin());
+    return res;
 }
 
 template<class _Ty, size_t Dim> 
@@ -696,16 +857,44 @@ auto Matrix<_Ty, Dim>:: raw_end()-> pointer{
     return start_ptr + size();
 }
 
+/*
+    A view is transposed in place, which takes it to be square. So is an
+    owner nobody else shares the storage with (a non-square one drops its
+    row padding), other owners get a new buffer and leave the old one to
+    the views of it.
+    Note the move constructor goes through copy assignment, which flags
+    the result as a view: a matrix move-constructed from an owner (e.g.
+    Mat<float> b(std::move(a))) is transposed as a view and throws when
+    it is not square. Move assignment keeps the flag.
+*/
 template<class _Ty, size_t Dim>
 template<_MAT_DIM_RESTRICT(_N == 2)>
 void Matrix<_Ty, Dim>::transpose(){
+    if(!is_valid())
+        throw zutil::error_invalid_use();
     if(is_view()){
         if(cols() != rows()){
             throw std::logic_error("cannot change the layout when transposing a matrix view.");
         }
-        for(size_t i = 0; i < rows(); ++i)
-            for(size_t j = 0; j < i; ++j)
-                std::swap(at(i, j), at(j, i));
+        if(step(1) == 1){
+            internal::transpose_square(start_ptr, step(0), rows());
+        }else{
+            for(size_t i = 0; i < rows(); ++i)
+                for(size_t j = 0; j < i; ++j)
+                    std::swap(at(i, j), at(j, i));
+        }
+    }else if(_raw_data.use_count() == 1 && _raw_data->owns_storage()){
+        size_t M = rows(), N = cols();
+        if(M == N){
+            internal::transpose_square(start_ptr, step(0), N);
+            return;
+        }
+        for(size_t i = 1; i < M && step(0) != N; ++i)
+            std::copy_n(start_ptr + i * step(0), N, start_ptr + i * N);
+        internal::transpose_inplace(start_ptr, M, N);
+        _sizes = {N, M};
+        _steps = {M, 1};
+        recalc_continuous();
     }else{
         *this = transposed();
     }
@@ -714,16 +903,123 @@ void Matrix<_Ty, Dim>::transpose(){
 template<class _Ty, size_t Dim> 
 template<_MAT_DIM_RESTRICT(_N <= 2)>
 auto Matrix<_Ty, Dim>::transposed() const-> Matrix<_Ty, 2>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
     if constexpr(Dim == 2){
-        self res(cols(), rows());
-        for(size_t i = 0; i < rows(); ++i)
-            for(size_t j = 0; j < cols(); ++j)
-                res.at(j, i) = at(i, j);
+        self res;
+        shape_t siz = {cols(), rows()};
+        res.init_uninit(siz.begin());
+        internal::transpose_copy(start_ptr, step(0), step(1), res.start_ptr, res.step(0), rows(), cols());
         return res;
     }else{
         return clone().reinterpret(size(), 1);
     }
 }
 
+template<class _Ty, size_t Dim>
+template<_MAT_DIM_RESTRICT(_N == 2)>
+auto Matrix<_Ty, Dim>::t()-> self{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    shape_t siz = {_sizes[1], _sizes[0]}, stp = {_steps[1], _steps[0]};
+    return self(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
+template<class _Ty, size_t Dim>
+template<_MAT_DIM_RESTRICT(_N == 2)>
+auto Matrix<_Ty, Dim>::t() const-> const self{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    shape_t siz = {_sizes[1], _sizes[0]}, stp = {_steps[1], _steps[0]};
+    return self(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
+template<class _Ty, size_t Dim>
+template<size_t ...Axes>
+auto Matrix<_Ty, Dim>::permute()-> self{
+    return std::as_const(*this).template permute<Axes...>();
+}
+
+template<class _Ty, size_t Dim>
+template<size_t ...Axes>
+auto Matrix<_Ty, Dim>::permute() const-> const self{
+    static_assert(internal::is_axes_permutation<Dim, Axes...>(), "Axes should be a permutation of the axes of the matrix.");
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    shape_t siz = {_sizes[Axes]...}, stp = {_steps[Axes]...};
+    return self(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::swapaxes(size_t a, size_t b)-> self{
+    return std::as_const(*this).swapaxes(a, b);
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::swapaxes(size_t a, size_t b) const-> const self{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    if(a >= Dim || b >= Dim)
+        throw zutil::error_out_of_range(std::max(a, b), Dim);
+    shape_t siz = _sizes, stp = _steps;
+    std::swap(siz[a], siz[b]);
+    std::swap(stp[a], stp[b]);
+    return self(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::expand_dims(size_t axis)-> Matrix<_Ty, Dim + 1>{
+    return std::as_const(*this).expand_dims(axis);
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::expand_dims(size_t axis) const-> const Matrix<_Ty, Dim + 1>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    if(axis > Dim)
+        throw zutil::error_out_of_range(axis, Dim + 1);
+
+    shape_type<Dim + 1> siz, stp;
+    for(size_t i = 0, k = 0; i <= Dim; ++i){
+        if(i == axis){
+            /*the step a continuous matrix would have there, so that it stays continuous.*/
+            siz[i] = 1;
+            stp[i] = axis < Dim? _sizes[axis] * _steps[axis]: 1;
+        }else{
+            siz[i] = _sizes[k];
+            stp[i] = _steps[k];
+            ++k;
+        }
+    }
+    return Matrix<_Ty, Dim + 1>(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
+template<class _Ty, size_t Dim>
+template<_MAT_DIM_RESTRICT(_N >= 2)>
+auto Matrix<_Ty, Dim>::squeeze(size_t axis)-> Matrix<_Ty, _N - 1>{
+    return std::as_const(*this).squeeze(axis);
+}
+
+template<class _Ty, size_t Dim>
+template<_MAT_DIM_RESTRICT(_N >= 2)>
+auto Matrix<_Ty, Dim>::squeeze(size_t axis) const-> const Matrix<_Ty, _N - 1>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    if(axis >= Dim)
+        throw zutil::error_out_of_range(axis, Dim);
+    if(_sizes[axis] != 1)
+        throw std::invalid_argument(zutil::as_str("cannot squeeze axis ", axis, " of size ", _sizes[axis]));
+
+    shape_type<Dim - 1> siz, stp;
+    for(size_t i = 0, k = 0; i < Dim; ++i){
+        if(i == axis)
+            continue;
+        siz[k] = _sizes[i];
+        stp[k] = _steps[i];
+        ++k;
+    }
+    return Matrix<_Ty, Dim - 1>(start_ptr, _raw_data, siz.begin(), stp.begin());
+}
+
 #undef _MAT_DIM_RESTRICT
 } // namespace zmat
\ No newline at end of file
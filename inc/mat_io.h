@@ -0,0 +1,286 @@
+#pragma once
+
+#include "mat.h"
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <charconv>
+#include <exception>
+#include <functional>
+
+namespace zmat{
+
+namespace internal{
+
+/*numpy dtype string of an arithmetic type, e.g. "<f4".*/
+template<class _Ty>
+std::string npy_descr(){
+    static_assert(std::is_arithmetic_v<_Ty> || std::is_same_v<_Ty, float16>, "only arithmetic types and float16 can be saved as .npy");
+    if constexpr(std::is_same_v<_Ty, float16>)
+        return "<f2";
+    char kind;
+    if constexpr(std::is_same_v<_Ty, bool>)
+        kind = 'b';
+    else if constexpr(std::is_floating_point_v<_Ty>)
+        kind = 'f';
+    else if constexpr(std::is_signed_v<_Ty>)
+        kind = 'i';
+    else
+        kind = 'u';
+    return std::string(1, sizeof(_Ty) == 1? '|': '<') + kind + std::to_string(sizeof(_Ty));
+}
+
+/*full .npy preamble (magic, version, length and padded header dict).*/
+std::string npy_header(const std::string& descr, bool fortran_order, const size_t* shape, size_t dim);
+
+/*read the preamble, leaving in at the start of the data.*/
+void npy_read_header(std::istream& in, std::string& descr, bool& fortran_order, std::vector<size_t>& shape);
+
+/*bytes of element data buffered at most when streaming a strided view.*/
+constexpr size_t NPY_BUFFER_BYTES = 1 << 20;
+
+bool text_blank_line(const char* p, const char* end);
+const char* text_skip_lines(const char* p, const char* end, size_t n);
+
+/*bounds of parts line-aligned chunks of [begin, end), parts + 1 pointers.*/
+std::vector<const char*> text_chunks(const char* begin, const char* end, size_t parts);
+
+/*# of non-blank lines.*/
+size_t text_count_rows(const char* p, const char* end);
+
+/*# of fields of a non-blank line.*/
+size_t text_count_fields(const char* p, const char* end, char delim);
+
+/*parse the cols fields of the line [p, end) into dst.*/
+template<class _Ty>
+void text_parse_line(const char* p, const char* end, char delim, _Ty* dst, size_t cols, size_t row){
+    auto blank = [](char c){ return c == ' ' || c == '\t' || c == '\r'; };
+    size_t k = 0;
+    while(true){
+        while(p != end && blank(*p))
+            ++p;
+        const char* tok = p;
+        if(delim == ' '){
+            while(p != end && !blank(*p))
+                ++p;
+            if(tok == p)
+                break;
+        }else{
+            while(p != end && *p != delim)
+                ++p;
+        }
+        const char* tok_end = p;
+        while(tok_end != tok && blank(tok_end[-1]))
+            --tok_end;
+
+        if(k == cols)
+            throw std::invalid_argument(zutil::as_str("row ", row, ": more than ", cols, " values"));
+        const char* num = tok != tok_end && *tok == '+'? tok + 1: tok;
+        auto [q, ec] = std::from_chars(num, tok_end, dst[k++]);
+        if(tok == tok_end || ec != std::errc() || q != tok_end)
+            throw std::invalid_argument(zutil::as_str("row ", row, ": cannot parse '", std::string(tok, tok_end), "'"));
+
+        if(p == end)
+            break;
+        if(delim != ' ')
+            ++p;
+    }
+    if(k != cols)
+        throw std::invalid_argument(zutil::as_str("row ", row, ": ", k, " values, expected ", cols));
+}
+
+} // namespace internal
+
+template<class _Ty, size_t Dim>
+void Matrix<_Ty, Dim>::save(std::ostream& out) const{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+
+    out << internal::npy_header(internal::npy_descr<_Ty>(), false, _sizes.data(), Dim);
+
+    if(is_continuous()){
+        out.write(reinterpret_cast<const char*>(start_ptr), size() * sizeof(_Ty));
+    }else{
+        size_t cap = std::max<size_t>(internal::NPY_BUFFER_BYTES / sizeof(_Ty), 1);
+        std::unique_ptr<_Ty[]> buf;
+        internal::stride_walk(_sizes, 1, [&](size_t n, auto src){
+            if(src.unit()){
+                out.write(reinterpret_cast<const char*>(src.ptr), n * sizeof(_Ty));
+                return;
+            }
+            for(size_t l = 0; l < n; l += cap){
+                size_t len = std::min(cap, n - l);
+                if(!buf)
+                    buf.reset(new _Ty[std::min(cap, n)]);
+                for(size_t j = 0; j < len; ++j)
+                    buf[j] = src[l + j];
+                out.write(reinterpret_cast<const char*>(buf.get()), len * sizeof(_Ty));
+            }
+        }, internal::walk_of(*this));
+    }
+
+    if(!out)
+        throw std::runtime_error("failed to write matrix data");
+}
+
+template<class _Ty, size_t Dim>
+void Matrix<_Ty, Dim>::save(const std::string& path) const{
+    std::ofstream out(path, std::ios::binary);
+    if(!out)
+        throw std::runtime_error("cannot open '" + path + "' for writing");
+    save(out);
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::load(std::istream& in)-> self{
+    std::string descr;
+    bool fortran_order;
+    std::vector<size_t> shape;
+    internal::npy_read_header(in, descr, fortran_order, shape);
+
+    if(descr != internal::npy_descr<_Ty>())
+        throw std::invalid_argument("element type mismatch: file holds " + descr + ", expected " + internal::npy_descr<_Ty>());
+    if(shape.size() != Dim)
+        throw std::invalid_argument(zutil::as_str("dimension mismatch: file holds ", shape.size(), ", expected ", Dim));
+    for(auto siz: shape){
+        if(siz == 0)
+            throw std::invalid_argument("matrix size cannot be zero.");
+    }
+
+    auto read = [&in](_Ty* dst, size_t n){
+        in.read(reinterpret_cast<char*>(dst), n * sizeof(_Ty));
+        if(static_cast<size_t>(in.gcount()) != n * sizeof(_Ty))
+            throw std::runtime_error("unexpected end of matrix data");
+    };
+
+    self res;
+    if(fortran_order && Dim > 1){
+        /*column-major data is kept as is, with the steps reversed.*/
+        internal::set_size_and_step(res._sizes, res._steps, shape.begin());
+        res._raw_data = internal::make_manager_uninit<_Ty>(res.size());
+        res.start_ptr = reinterpret_cast<_Ty*>(res._raw_data->get_data());
+        read(res.start_ptr, res.size());
+        res._steps[0] = 1;
+        for(size_t i = 1; i < Dim; ++i)
+            res._steps[i] = res._steps[i - 1] * res._sizes[i - 1];
+        res.flag = CONTINUOUS_FLAG;
+        res.recalc_continuous();
+        return res;
+    }
+
+    res.init_uninit(shape.begin());
+    if constexpr(Dim >= 2){
+        if(!res.is_continuous()){
+            /*padded rows, which are equally spaced.*/
+            size_t cols = res.size(Dim - 1);
+            for(size_t r = 0; r < res.size() / cols; ++r)
+                read(res.start_ptr + r * res.step(Dim - 2), cols);
+            return res;
+        }
+    }
+    read(res.start_ptr, res.size());
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::load(const std::string& path)-> self{
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        throw std::runtime_error("cannot open '" + path + "' for reading");
+    return load(in);
+}
+
+template<class _Ty, size_t Dim>
+template<size_t _N, std::enable_if_t<(_N == 2) && (_N == Dim), size_t> _>
+auto Matrix<_Ty, Dim>::from_text(std::string_view text, char delim, size_t skip_rows)-> self{
+    return from_text(text, shape_t{0, 0}, delim, skip_rows);
+}
+
+template<class _Ty, size_t Dim>
+template<size_t _N, std::enable_if_t<(_N == 2) && (_N == Dim), size_t> _>
+auto Matrix<_Ty, Dim>::from_text(std::string_view text, const shape_t& shape, char delim, size_t skip_rows)-> self{
+    static_assert(std::is_arithmetic_v<_Ty> && !std::is_same_v<_Ty, bool>, "only numbers can be parsed from text");
+
+    const char* end = text.data() + text.size();
+    const char* begin = internal::text_skip_lines(text.data(), end, skip_rows);
+
+    size_t nth = internal::parallel_threads((end - begin) / sizeof(_Ty));
+    auto bounds = internal::text_chunks(begin, end, nth);
+
+    /*rows of each chunk, so that every chunk knows where its first row goes.*/
+    std::vector<size_t> first_row(nth + 1, 0);
+    internal::parallel_for_range(nth, nth, [&](size_t l, size_t r){
+        for(size_t c = l; c < r; ++c)
+            first_row[c + 1] = internal::text_count_rows(bounds[c], bounds[c + 1]);
+    });
+    for(size_t c = 0; c < nth; ++c)
+        first_row[c + 1] += first_row[c];
+
+    size_t rows = first_row[nth], cols = shape[1];
+    if(rows == 0)
+        throw std::invalid_argument("matrix size cannot be zero.");
+    if(shape[0] != 0 && shape[0] != rows)
+        throw std::invalid_argument(zutil::as_str("text holds ", rows, " rows, expected ", shape[0]));
+    if(cols == 0){
+        const char* p = begin;
+        for(const char* q; ; p = q + 1){
+            q = std::find(p, end, '\n');
+            if(!internal::text_blank_line(p, q)){
+                cols = internal::text_count_fields(p, q, delim);
+                break;
+            }
+        }
+    }
+
+    self res;
+    shape_t siz = {rows, cols};
+    res.init_uninit(siz.begin());
+    size_t pitch = res.step(0);
+
+    std::vector<std::exception_ptr> errors(nth);
+    internal::parallel_for_range(nth, nth, [&](size_t l, size_t r){
+        for(size_t c = l; c < r; ++c){
+            try{
+                size_t row = first_row[c];
+                for(const char* p = bounds[c]; p != bounds[c + 1];){
+                    const char* q = std::find(p, bounds[c + 1], '\n');
+                    if(!internal::text_blank_line(p, q)){
+                        internal::text_parse_line(p, q, delim, res.start_ptr + row * pitch, cols, row);
+                        ++row;
+                    }
+                    p = q == bounds[c + 1]? q: q + 1;
+                }
+            }catch(...){
+                errors[c] = std::current_exception();
+            }
+        }
+    });
+    for(auto& err: errors)
+        if(err)
+            std::rethrow_exception(err);
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+template<size_t _N, std::enable_if_t<(_N == 2) && (_N == Dim), size_t> _>
+auto Matrix<_Ty, Dim>::from_csv(const std::string& path, char delim, size_t skip_rows)-> self{
+    return from_csv(path, shape_t{0, 0}, delim, skip_rows);
+}
+
+template<class _Ty, size_t Dim>
+template<size_t _N, std::enable_if_t<(_N == 2) && (_N == Dim), size_t> _>
+auto Matrix<_Ty, Dim>::from_csv(const std::string& path, const shape_t& shape, char delim, size_t skip_rows)-> self{
+    size_t bytes = internal::file_size(path);
+    if(bytes == 0)
+        throw std::invalid_argument("file '" + path + "' is empty");
+
+    void* base;
+    size_t length;
+    auto text = static_cast<const char*>(internal::map_file(path, 0, bytes, MAP_MODE_READ, base, length));
+    std::unique_ptr<void, std::function<void(void*)>> guard(base, [length](void* ptr){
+        internal::unmap_file(ptr, length);
+    });
+    return from_text(std::string_view(text, bytes), shape, delim, skip_rows);
+}
+
+} // namespace zmat
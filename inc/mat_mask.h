@@ -0,0 +1,460 @@
+#pragma once
+
+#include "mat.h"
+#include "mat_ops.h"
+#include "mat_expr.h"
+#include "kernel/simd.h"
+#include <bit>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <limits>
+
+namespace zmat{
+
+namespace internal{
+
+/*selects constructors that leave storage unset.*/
+struct uninit_tag{};
+
+} // namespace internal
+
+/*
+    Boolean matrix packed one bit per element, in row-major order. It is
+    what the comparison operators return, and drives Matrix::select and
+    Matrix::assign. Bits past the last element are kept clear, so counting
+    and comparing work on whole words.
+*/
+template<size_t Dim>
+class Mask{
+    static_assert(Dim >= 1, "Dimension could not less than 1");
+
+    using self = Mask<Dim>;
+
+public:
+    using shape_t = shape_type<Dim>;
+    using index_t = ptrdiff_t;
+
+    static constexpr size_t WORD_BITS = 64;
+
+    Mask() = default;
+
+    explicit Mask(const shape_t& sizes, bool val = false): Mask(sizes, internal::uninit_tag()){
+        std::fill_n(bits, nwords, val? ~uint64_t(0): 0);
+        clear_tail();
+    }
+
+    /*words are left unset, for producers that write every one of them.*/
+    Mask(const shape_t& sizes, internal::uninit_tag): _sizes(sizes){
+        size_t n = size();
+        if(n == 0)
+            throw std::invalid_argument("matrix size cannot be zero.");
+        nwords = (n + WORD_BITS - 1) / WORD_BITS;
+        _raw_data = internal::make_manager_uninit<uint64_t>(nwords);
+        bits = static_cast<uint64_t*>(_raw_data->get_data());
+    }
+
+    Mask(const self& b): _sizes(b._sizes), nwords(b.nwords){
+        if(b.is_valid()){
+            _raw_data = b._raw_data->clone();
+            bits = static_cast<uint64_t*>(_raw_data->get_data());
+        }
+    }
+
+    Mask(self&& b) noexcept: _sizes(b._sizes), _raw_data(std::move(b._raw_data)), bits(b.bits), nwords(b.nwords){
+        b.bits = nullptr;
+        b.nwords = 0;
+    }
+
+    self& operator =(const self& b){
+        if(this != &b)
+            *this = self(b);
+        return *this;
+    }
+
+    self& operator =(self&& b) noexcept{
+        _sizes = b._sizes;
+        _raw_data = std::move(b._raw_data);
+        bits = std::exchange(b.bits, nullptr);
+        nwords = std::exchange(b.nwords, 0);
+        return *this;
+    }
+
+    bool is_valid() const{
+        return bits != nullptr;
+    }
+
+    size_t dims() const{
+        return Dim;
+    }
+
+    size_t size() const{
+        size_t tot = 1;
+        for(auto i: _sizes)
+            tot *= i;
+        return tot;
+    }
+
+    size_t size(size_t index) const{
+        return _sizes[index];
+    }
+
+    const shape_t& shape() const{
+        return _sizes;
+    }
+
+    /*packed storage, element i is bit i % 64 of word i / 64.*/
+    uint64_t* words(){
+        return bits;
+    }
+
+    const uint64_t* words() const{
+        return bits;
+    }
+
+    size_t word_count() const{
+        return nwords;
+    }
+
+    template<class ...Types, std::enable_if_t<(sizeof...(Types) == Dim), size_t> _ = 0>
+    bool at(Types ...indices) const{
+        static_assert((std::is_convertible_v<Types, index_t> && ...), "Index should be size type.");
+        if(!is_valid())
+            throw zutil::error_invalid_use();
+
+        index_t idx[] = {static_cast<index_t>(indices)...};
+        size_t pos = 0;
+        for(size_t i = 0; i < Dim; ++i){
+            if(idx[i] < 0)
+                idx[i] += size(i);
+            if(idx[i] >= size(i) || idx[i] < 0)
+                throw zutil::error_out_of_range(idx[i], size(i));
+            pos = pos * size(i) + idx[i];
+        }
+        return bits[pos / WORD_BITS] >> (pos % WORD_BITS) & 1;
+    }
+
+    /*# of set elements.*/
+    size_t count() const{
+        size_t res = 0;
+        for(size_t i = 0; i < nwords; ++i)
+            res += std::popcount(bits[i]);
+        return res;
+    }
+
+    bool any() const{
+        for(size_t i = 0; i < nwords; ++i)
+            if(bits[i])
+                return true;
+        return false;
+    }
+
+    bool all() const{
+        return is_valid() && count() == size();
+    }
+
+    self operator ~() const{
+        self res = *this;
+        #pragma omp simd
+        for(size_t i = 0; i < nwords; ++i)
+            res.bits[i] = ~res.bits[i];
+        res.clear_tail();
+        return res;
+    }
+
+    self& operator &=(const self& b){
+        check_shape(b);
+        #pragma omp simd
+        for(size_t i = 0; i < nwords; ++i)
+            bits[i] &= b.bits[i];
+        return *this;
+    }
+
+    self& operator |=(const self& b){
+        check_shape(b);
+        #pragma omp simd
+        for(size_t i = 0; i < nwords; ++i)
+            bits[i] |= b.bits[i];
+        return *this;
+    }
+
+    self& operator ^=(const self& b){
+        check_shape(b);
+        #pragma omp simd
+        for(size_t i = 0; i < nwords; ++i)
+            bits[i] ^= b.bits[i];
+        return *this;
+    }
+
+    self operator &(const self& b) const{
+        self res = *this;
+        return res &= b;
+    }
+
+    self operator |(const self& b) const{
+        self res = *this;
+        return res |= b;
+    }
+
+    self operator ^(const self& b) const{
+        self res = *this;
+        return res ^= b;
+    }
+
+    bool operator ==(const self& b) const{
+        if(!is_valid() || !b.is_valid())
+            return is_valid() == b.is_valid();
+        return _sizes == b._sizes && std::equal(bits, bits + nwords, b.bits);
+    }
+
+    bool operator !=(const self& b) const{
+        return !(*this == b);
+    }
+
+    /*unpacked copy, one bool per element.*/
+    Matrix<bool, Dim> to_matrix() const{
+        if(!is_valid())
+            throw zutil::error_invalid_use();
+        Matrix<bool, Dim> res(_sizes);
+        size_t pos = 0;
+        internal::stride_walk(_sizes, 1, [&](size_t n, auto dst){
+            for(size_t j = 0; j < n; ++j, ++pos)
+                dst[j] = bits[pos / WORD_BITS] >> (pos % WORD_BITS) & 1;
+        }, internal::walk_of(res));
+        return res;
+    }
+
+    operator Matrix<bool, Dim>() const{
+        return to_matrix();
+    }
+
+private:
+    shape_t _sizes{};
+    std::shared_ptr<internal::MatrixData<void>> _raw_data;
+    uint64_t* bits = nullptr;
+    size_t nwords = 0;
+
+    void clear_tail(){
+        size_t rem = size() % WORD_BITS;
+        if(rem)
+            bits[nwords - 1] &= (uint64_t(1) << rem) - 1;
+    }
+
+    void check_shape(const self& b) const{
+        if(!is_valid() || !b.is_valid())
+            throw zutil::error_invalid_use();
+        if(_sizes != b._sizes)
+            throw std::invalid_argument("shape mismatch");
+    }
+};
+
+template<size_t Dim>
+std::ostream& operator <<(std::ostream& out, const Mask<Dim>& mask){
+    if(!mask.is_valid())
+        return out << "null";
+    return out << mask.to_matrix();
+}
+
+namespace internal{
+
+/*
+    compare the operands a and b (matrices, or a value with zero steps) read
+    as the given shape. When flat (a dense, b dense or a single value) whole
+    words are produced in parallel, otherwise the elements are walked in
+    row-major order.
+*/
+template<class _Cmp, class _Ta, class _Tb, size_t Dim>
+Mask<Dim> mask_compare(const shape_type<Dim>& shape, const walk_operand<const _Ta, Dim>& a,
+                       const walk_operand<const _Tb, Dim>& b, bool flat){
+    constexpr size_t W = Mask<Dim>::WORD_BITS;
+
+    if(flat){
+        Mask<Dim> res(shape, uninit_tag());
+        uint64_t* out = res.words();
+        size_t n = res.size(), sb = b.steps[Dim - 1];
+        parallel_for_range(res.word_count(), parallel_threads(n), [&](size_t l, size_t r){
+            for(size_t w = l; w < r; ++w)
+                out[w] = simd::cmp_bits<_Cmp>(a.ptr + w * W, 1, b.ptr + w * W * sb, sb, std::min(W, n - w * W));
+        });
+        return res;
+    }
+
+    Mask<Dim> res(shape);
+    uint64_t* out = res.words();
+    size_t pos = 0;
+    stride_walk(shape, 1, [&](size_t n, auto x, auto y){
+        for(size_t i = 0; i < n;){
+            size_t off = pos % W, len = std::min(W - off, n - i);
+            out[pos / W] |= simd::cmp_bits<_Cmp>(&x[i], x.step, &y[i], y.step, len) << off;
+            pos += len;
+            i += len;
+        }
+    }, a, b);
+    return res;
+}
+
+template<class _Cmp, class _Ty, class _T, size_t Dim>
+Mask<Dim> mask_compare(const Matrix<_Ty, Dim>& a, const walk_operand<const _T, Dim>& b, bool b_flat){
+    return mask_compare<_Cmp>(shape_of(a), walk_of(a), b, a.is_continuous() && b_flat);
+}
+
+/*both operands are broadcast to the shape of the result, like the operands of an expression.*/
+template<class _Cmp, class _Ty, class _T, size_t Dim, size_t _N>
+auto mask_compare(const Matrix<_Ty, Dim>& a, const Matrix<_T, _N>& b)-> Mask<(Dim > _N? Dim: _N)>{
+    constexpr size_t D = Dim > _N? Dim: _N;
+    if(!a.is_valid() || !b.is_valid())
+        throw zutil::error_invalid_use();
+    auto shape = broadcast_shape<D>(shape_of(a), shape_of(b));
+    size_t n = 1;
+    for(auto siz: shape)
+        n *= siz;
+    bool flat = a.is_continuous() && a.size() == n && b.is_continuous() && b.size() == n;
+    return mask_compare<_Cmp>(shape, broadcast_of(a, shape), broadcast_of(b, shape), flat);
+}
+
+/*whether static_cast<_Ty>(val) is defined: a floating value has to be a number inside the range of an integer type.*/
+template<class _Ty, class _T>
+bool scalar_in_range(const _T& val){
+    if constexpr(std::is_floating_point_v<_T> && std::is_integral_v<_Ty> && !std::is_same_v<_Ty, bool>){
+        /*lowest() and max() + 1 are powers of two (or 0), exact in _T, unlike max() itself.*/
+        const _T lo = static_cast<_T>(std::numeric_limits<_Ty>::lowest());
+        const _T hi = static_cast<_T>(std::numeric_limits<_Ty>::max() / 2 + 1) * 2;
+        return val == val && val >= lo && val < hi;
+    }else{
+        return true;
+    }
+}
+
+/*a scalar the matrix type represents exactly is compared as that type, which keeps the vector kernels.*/
+template<class _Cmp, class _Ty, class _T, size_t Dim>
+Mask<Dim> mask_compare_scalar(const Matrix<_Ty, Dim>& a, const _T& val){
+    if(!a.is_valid())
+        throw zutil::error_invalid_use();
+    if constexpr(std::is_arithmetic_v<_T> && std::is_arithmetic_v<_Ty> && !std::is_same_v<_T, _Ty>){
+        if(scalar_in_range<_Ty>(val)){
+            _Ty cast = static_cast<_Ty>(val);
+            if(static_cast<_T>(cast) == val)
+                return mask_compare<_Cmp>(a, walk_operand<const _Ty, Dim>{&cast, {}}, true);
+        }
+    }
+    return mask_compare<_Cmp>(a, walk_operand<const _T, Dim>{&val, {}}, true);
+}
+
+/*call fn(elements...) for the elements of the operands where mask is set, in row-major order.*/
+template<size_t Dim, class _Fn, class ..._Ts>
+void mask_walk(const Mask<Dim>& mask, _Fn fn, const walk_operand<_Ts, Dim>& ...ops){
+    constexpr size_t W = Mask<Dim>::WORD_BITS;
+    const uint64_t* words = mask.words();
+    size_t pos = 0;
+    stride_walk(mask.shape(), 1, [&](size_t n, auto ...spans){
+        for(size_t i = 0; i < n;){
+            size_t off = pos % W, len = std::min(W - off, n - i);
+            uint64_t bits = words[pos / W] >> off;
+            if(len < W)
+                bits &= (uint64_t(1) << len) - 1;
+            for(; bits; bits &= bits - 1){
+                size_t k = i + std::countr_zero(bits);
+                fn(spans[k]...);
+            }
+            pos += len;
+            i += len;
+        }
+    }, ops...);
+}
+
+template<size_t Dim, class _Ty>
+void mask_check(const Mask<Dim>& mask, const Matrix<_Ty, Dim>& mat){
+    if(!mask.is_valid() || !mat.is_valid())
+        throw zutil::error_invalid_use();
+    if(mask.shape() != shape_of(mat))
+        throw std::invalid_argument("shape mismatch");
+}
+
+} // namespace internal
+
+template<class _Ty, size_t Dim>
+template<class _T, size_t _N>
+auto Matrix<_Ty, Dim>::operator <(const Matrix<_T, _N>& b) const-> Mask<(Dim > _N? Dim: _N)>{
+    return internal::mask_compare<simd::cmp_lt>(*this, b);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, size_t _N>
+auto Matrix<_Ty, Dim>::operator <=(const Matrix<_T, _N>& b) const-> Mask<(Dim > _N? Dim: _N)>{
+    return internal::mask_compare<simd::cmp_le>(*this, b);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, size_t _N>
+auto Matrix<_Ty, Dim>::operator >(const Matrix<_T, _N>& b) const-> Mask<(Dim > _N? Dim: _N)>{
+    return internal::mask_compare<simd::cmp_gt>(*this, b);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, size_t _N>
+auto Matrix<_Ty, Dim>::operator >=(const Matrix<_T, _N>& b) const-> Mask<(Dim > _N? Dim: _N)>{
+    return internal::mask_compare<simd::cmp_ge>(*this, b);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>::operator <(const _T& val) const-> Mask<Dim>{
+    return internal::mask_compare_scalar<simd::cmp_lt>(*this, val);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>::operator <=(const _T& val) const-> Mask<Dim>{
+    return internal::mask_compare_scalar<simd::cmp_le>(*this, val);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>::operator >(const _T& val) const-> Mask<Dim>{
+    return internal::mask_compare_scalar<simd::cmp_gt>(*this, val);
+}
+
+template<class _Ty, size_t Dim>
+template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>::operator >=(const _T& val) const-> Mask<Dim>{
+    return internal::mask_compare_scalar<simd::cmp_ge>(*this, val);
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::select(const Mask<Dim>& mask) const-> Matrix<_Ty, 1>{
+    internal::mask_check(mask, *this);
+    size_t cnt = mask.count();
+    if(cnt == 0)
+        return Matrix<_Ty, 1>();
+
+    Matrix<_Ty, 1> res(cnt);
+    _Ty* dst = res.raw_begin();
+    internal::mask_walk(mask, [&dst](const _Ty& x){
+        *dst++ = x;
+    }, internal::walk_of(*this));
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::assign(const Mask<Dim>& mask, const _Ty& val)-> self&{
+    internal::mask_check(mask, *this);
+    internal::mask_walk(mask, [&val](_Ty& x){
+        x = val;
+    }, internal::walk_of(*this));
+    return *this;
+}
+
+template<class _Ty, size_t Dim>
+template<class _T>
+auto Matrix<_Ty, Dim>::assign(const Mask<Dim>& mask, const Matrix<_T, Dim>& src)-> self&{
+    internal::mask_check(mask, *this);
+    internal::mask_check(mask, src);
+    if(internal::mat_overlap(*this, src))
+        return assign(mask, src.clone());
+    internal::mask_walk(mask, [](_Ty& x, const _T& y){
+        x = y;
+    }, internal::walk_of(*this), internal::walk_of(src));
+    return *this;
+}
+
+} // namespace zmat
@@ -2,12 +2,66 @@
 
 #include "mat.h"
 #include "kernel/simd.h"
+#include "kernel/gemm.h"
 #include <iostream>
 #include <cstdio>
 #include <algorithm>
 
 namespace zmat{
 
+namespace internal{
+
+/*text is handed to the stream in chunks of about this size.*/
+constexpr size_t PRINT_FLUSH_BYTES = 1 << 16;
+
+/*per-thread buffer reused by print, taken with swap so nested prints get their own.*/
+inline std::string& print_buffer(){
+    static thread_local std::string buf;
+    return buf;
+}
+
+/*
+    append the dim-dimensional block at ptr to buf. fmt formats this level;
+    deeper levels use it too if it is recursive, otherwise dflt.
+*/
+template<class _Ty>
+void print_block(std::ostream& out, std::string& buf, const _Ty* ptr, const size_t* sizes, const size_t* steps,
+                 size_t dim, formatter<_Ty>& fmt, formatter<_Ty>& dflt){
+    formatter<_Ty>& sub = fmt.recursive? fmt: dflt;
+    size_t siz = sizes[0];
+    bool elide = siz > std::max(fmt.max_items, fmt.front_items + fmt.back_items);
+    size_t front = elide? fmt.front_items: siz;
+
+    auto items = [&](size_t l, size_t n){
+        if(dim == 1){
+            fmt.write(buf, ptr + l * steps[0], n, steps[0]);
+            return;
+        }
+        for(size_t i = l; i < l + n; ++i){
+            if(i != l)
+                buf += fmt.del;
+            print_block(out, buf, ptr + i * steps[0], sizes + 1, steps + 1, dim - 1, sub, dflt);
+            if(buf.size() >= PRINT_FLUSH_BYTES){
+                out.write(buf.data(), buf.size());
+                buf.clear();
+            }
+        }
+    };
+
+    buf += fmt.st;
+    items(0, front);
+    if(elide){
+        if(front)
+            buf += fmt.del;
+        buf += "...";
+        buf += fmt.del;
+        items(siz - fmt.back_items, fmt.back_items);
+    }
+    buf += fmt.ed;
+}
+
+} // namespace internal
+
 template<class _Ty, size_t Dim>
 void Matrix<_Ty, Dim>::print(std::ostream& out, std::shared_ptr<formatter<_Ty>> nfmt) const{
     if(!is_valid()){
@@ -15,45 +69,14 @@ void Matrix<_Ty, Dim>::print(std::ostream& out, std::shared_ptr<formatter<_Ty>>
         return;
     }
     if(!nfmt)
-        nfmt = fmt;
-    out << nfmt->st;
-
-    size_t siz = size(0);
-
-    if(siz > std::max(nfmt->max_items, nfmt->front_items + nfmt->back_items)){
-        for(size_t i = 0; i < nfmt->front_items; ++i){
-            if constexpr(Dim == 1){
-                out << nfmt->to_string((*this)[i]);
-            }else{
-                (*this)[i].print(out, (nfmt->recursive? nfmt: nullptr));
-            }
-            out << nfmt->del;
-        }
-
-        out << "..." << nfmt->del;
+        nfmt = fmt? fmt: default_format();
 
-        for(index_t i = -(index_t)nfmt->back_items; i < 0; ++i){
-            if constexpr(Dim == 1){
-                out << nfmt->to_string((*this)[i]);
-            }else{
-                (*this)[i].print(out, (nfmt->recursive? nfmt: nullptr));
-            }
-            if(i != - 1)
-                out << nfmt->del;
-        }
-    }else{
-        for(size_t i = 0; i < siz; ++i){
-            if constexpr(Dim == 1){
-                out << nfmt->to_string((*this)[i]);
-            }else{
-                (*this)[i].print(out, (nfmt->recursive? nfmt: nullptr));
-            }
-            if(i != siz - 1)
-                out << nfmt->del;
-        }
-    }
-
-    out << nfmt->ed;
+    std::string buf;
+    buf.swap(internal::print_buffer());
+    buf.clear();
+    internal::print_block(out, buf, start_ptr, _sizes.data(), _steps.data(), Dim, *nfmt, *default_format());
+    out.write(buf.data(), buf.size());
+    buf.swap(internal::print_buffer());
 }
 
 template<class _Ty, size_t Dim>
@@ -65,23 +88,18 @@ std::ostream& operator <<(std::ostream& out, const Matrix<_Ty, Dim>& mat){
 namespace internal{
 template<class _T1, class _T2, class _Res, class _Fn, size_t Dim>
 void mat_apply(const Matrix<_T1, Dim>& a, const Matrix<_T2, Dim>& b, Matrix<_Res, Dim>& res, _Fn func){
-    if(a.is_continuous() && b.is_continuous()){
-        std::transform(a.raw_begin(), a.raw_end(), b.raw_begin(), res.raw_begin(), func);
-    }else if(a.is_continuous()){
-        std::transform(a.raw_begin(), a.raw_end(), b.begin(), res.raw_begin(), func);
-    }else if(b.is_continuous()){
-        std::transform(a.begin(), a.end(), b.raw_begin(), res.raw_begin(), func);
-    }else{
-        std::transform(a.begin(), a.end(), b.begin(), res.raw_begin(), func);
-    }
+    stride_walk(shape_of(a), 1, [&func](size_t n, auto x, auto y, auto dst){
+        for(size_t j = 0; j < n; ++j)
+            dst[j] = func(x[j], y[j]);
+    }, walk_of(a), walk_of(b), walk_of(res));
 }
 
 template<class _T1, class _Res, class _Fn, size_t Dim>
 void mat_apply(const Matrix<_T1, Dim>& a, Matrix<_Res, Dim>& res, _Fn func){
-    if(a.is_continuous())
-        std::transform(a.raw_begin(), a.raw_end(), res.raw_begin(), func);
-    else
-        std::transform(a.begin(), a.end(), res.raw_begin(), func);
+    stride_walk(shape_of(a), 1, [&func](size_t n, auto x, auto dst){
+        for(size_t j = 0; j < n; ++j)
+            dst[j] = func(x[j]);
+    }, walk_of(a), walk_of(res));
 }
 
 template<class _It1, class _It2>
@@ -128,210 +146,193 @@ bool mat_cmp(const Matrix<_T1, Dim>& a, const Matrix<_T2, Dim>& b){
     }
 }
 
-template<typename _Ty>
-void gemm(const _Ty *a, const _Ty *b, _Ty* dst,
-             const size_t M, const size_t K, const size_t N,
-             const size_t step_a, const size_t step_b, const size_t step_dst){
-    constexpr size_t BS = 1024 / sizeof(_Ty);
-    constexpr size_t MAT_ALIGN = 16;
-
-    alignas(MAT_ALIGN) _Ty a_buf[BS][BS];
-    alignas(MAT_ALIGN) _Ty b_buf[BS][BS];
-    alignas(MAT_ALIGN) _Ty res_buf[BS][BS] = {};
-
-    for(size_t bi = 0; bi < M; bi += BS){
-        size_t li = std::min(M - bi, BS);
-        for(size_t bk = 0; bk < K; bk += BS){
-            size_t lk = std::min(K - bk, BS);
-            for(int i = 0; i < li; ++i){
-                auto ptr = a + (i + bi) * step_a + bk;
-                for(int k = 0; k < lk; ++k)
-                    a_buf[i][k] = ptr[k];
-            }
+template<class _T1, class _T2, size_t Dim>
+bool mat_same_shape(const Matrix<_T1, Dim>& a, const Matrix<_T2, Dim>& b){
+    for(size_t i = 0; i < Dim; ++i)
+        if(a.size(i) != b.size(i))
+            return false;
+    return true;
+}
 
-            for(size_t bj = 0; bj < N; bj += BS){
-                size_t lj = std::min(N - bj, BS);
+/*
+    true if updating a in order could read an element of b that was already
+    written. Identical views are safe, since every element only reads itself.
+*/
+template<class _T1, class _T2, size_t _N1, size_t _N2>
+bool mat_overlap(const Matrix<_T1, _N1>& a, const Matrix<_T2, _N2>& b){
+    auto lo1 = reinterpret_cast<uintptr_t>(a.raw_begin());
+    auto lo2 = reinterpret_cast<uintptr_t>(b.raw_begin());
+    bool same_steps = sizeof(_T1) == sizeof(_T2) && _N1 == _N2;
+    size_t ext1 = 1, ext2 = 1;
+    for(size_t i = 0; i < _N1; ++i)
+        ext1 += (a.size(i) - 1) * a.step(i);
+    for(size_t i = 0; i < _N2; ++i)
+        ext2 += (b.size(i) - 1) * b.step(i);
+    if constexpr(_N1 == _N2){
+        for(size_t i = 0; i < _N1; ++i)
+            same_steps = same_steps && a.size(i) == b.size(i) && a.step(i) == b.step(i);
+    }
+    if(lo1 == lo2 && same_steps)
+        return false;
+    return lo1 < lo2 + ext2 * sizeof(_T2) && lo2 < lo1 + ext1 * sizeof(_T1);
+}
+
+/*
+    src read as if it had the given shape, numpy style: axes are aligned from
+    the right, and missing or size-1 axes are repeated with a zero step.
+*/
+template<class _T, size_t _N, size_t Dim>
+walk_operand<const _T, Dim> broadcast_of(const Matrix<_T, _N>& src, const shape_type<Dim>& shape){
+    static_assert(_N <= Dim, "cannot broadcast to fewer dimensions");
+    walk_operand<const _T, Dim> res{src.raw_begin(), {}};
+    for(size_t i = 0; i < _N; ++i){
+        if(src.size(i) == shape[Dim - _N + i])
+            res.steps[Dim - _N + i] = src.step(i);
+        else if(src.size(i) != 1)
+            throw std::invalid_argument("shape mismatch");
+    }
+    return res;
+}
 
-                for(int k = 0; k < lk; ++k){
-                    auto ptr = b + (k + bk) * step_b + bj;
-                    for(int j = 0; j < lj; ++j)
-                        b_buf[k][j] = ptr[j];
-                }
+/*dst op= src through one of the simd in-place kernels, without allocating. src is broadcast to dst.*/
+template<class _Kernel, class _Ty, class _T, size_t Dim, size_t _N>
+void mat_update(Matrix<_Ty, Dim>& dst, const Matrix<_T, _N>& src){
+    if(!dst.is_valid() || !src.is_valid())
+        throw zutil::error_invalid_use();
+    auto bsrc = broadcast_of(src, shape_of(dst));
+    if(mat_overlap(dst, src)){
+        mat_update<_Kernel>(dst, src.clone());
+        return;
+    }
 
-                for(int i = 0; i < li; ++i){
-                    for(int k = 0; k < lk; ++k){
-                        #pragma omp simd
-                        for(int j = 0; j < lj; ++j){
-                            res_buf[i][j] += a_buf[i][k] * b_buf[k][j];
-                        }
-                    }
-                }
+    size_t n = dst.size();
+    size_t nth = parallel_threads(n);
 
-                for(int i = 0; i < li; ++i){
-                    auto ptr = dst + (i + bi) * step_dst + bj;
-                    for(int j = 0; j < lj; ++j){
-                        ptr[j] += res_buf[i][j];
-                        res_buf[i][j] = 0;
-                    }
-                }
-            }
-        }
+    if(dst.is_continuous() && src.is_continuous() && src.size() == n){
+        _Ty* d = dst.raw_begin();
+        const _T* s = src.raw_begin();
+        parallel_for_range(n, nth, [d, s](size_t l, size_t r){
+            _Kernel::apply(d + l, s + l, r - l);
+        });
+        return;
     }
-}
 
+    stride_walk(shape_of(dst), nth, [](size_t len, auto d, auto s){
+        _Kernel::apply(d.ptr, d.step, s.ptr, s.step, len);
+    }, walk_of(dst), bsrc);
 }
 
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>:: operator <<=(const Matrix<_T, Dim>& mat)-> self&{
-    if(!is_valid())
+/*dst op= val for every element.*/
+template<class _Kernel, class _Ty, class _T, size_t Dim>
+void mat_update_scalar(Matrix<_Ty, Dim>& dst, const _T& val){
+    if(!dst.is_valid())
         throw zutil::error_invalid_use();
-    if(_sizes != mat._sizes)
-        throw std::invalid_argument("shape mismatch");
 
-    if(mat.is_continuous()){
-        if(is_continuous())
-            std::copy_n(mat.raw_begin(), mat.size(), raw_begin());
-        else
-            std::copy_n(mat.raw_begin(), mat.size(), begin());
-    }else{
-        if(is_continuous())
-            std::copy_n(mat.begin(), mat.size(), raw_begin());
-        else
-            std::copy_n(mat.begin(), mat.size(), begin());
+    size_t n = dst.size();
+    size_t nth = parallel_threads(n);
+    _Ty* d = dst.raw_begin();
+
+    if(dst.is_continuous()){
+        parallel_for_range(n, nth, [d, &val](size_t l, size_t r){
+            _Kernel::apply_scalar(d + l, val, r - l);
+        });
+        return;
     }
 
-    return *this;
+    size_t len = dst.size(Dim - 1), rows = n / len;
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(size_t r = 0; r < rows; ++r){
+        _Ty* dp = d;
+        for(size_t i = Dim - 1, rem = r; i-- > 0;){
+            dp += rem % dst.size(i) * dst.step(i);
+            rem /= dst.size(i);
+        }
+        _Kernel::apply_scalar(dp, dst.step(Dim - 1), val, len);
+    }
 }
 
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>:: operator <<=(const _T& val)-> self&{
+}
 
-    if(!is_valid())
+template<class _Ty, size_t Dim>
+template<class _T, size_t _N>
+auto Matrix<_Ty, Dim>:: operator <<=(const Matrix<_T, _N>& mat)-> self&{
+    if(!is_valid() || !mat.is_valid())
         throw zutil::error_invalid_use();
-
-    if(is_continuous()){
-        std::fill_n(raw_begin(), size(), val);
-    }else{
-        std::fill_n(begin(), size(), val);
-    }
+    if(internal::mat_overlap(*this, mat))
+        return *this <<= mat.clone();
+
+    internal::stride_walk(_sizes, internal::parallel_threads(size()), [](size_t n, auto dst, auto src){
+        if constexpr(std::is_same_v<_Ty, _T>){
+            if(dst.unit() && src.unit()){
+                std::copy_n(src.ptr, n, dst.ptr);
+                return;
+            }
+        }
+        simd::convert<false, false>(src.ptr, src.step, dst.ptr, dst.step, n);
+    }, internal::walk_of(*this), internal::broadcast_of(mat, _sizes));
 
     return *this;
 }
 
 template<class _Ty, size_t Dim>
-template<class _T>
-Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator +(const Matrix<_T, Dim>& b) const{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");
-    
-    Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim> res(_sizes);
-    internal::mat_apply(*this, b, res, std::plus<>());
-    return res;
-}
+template<class _T, std::enable_if_t<!is_mat_like_v<_T>, size_t> _>
+auto Matrix<_Ty, Dim>:: operator <<=(const _T& val)-> self&{
 
-template<class _Ty, size_t Dim>
-template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _>
-Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator +(const _T& b) const{
     if(!is_valid())
         throw zutil::error_invalid_use();
 
-    Matrix<decltype(std::declval<_Ty>() + std::declval<_T>()), Dim> res(_sizes);
-    internal::mat_apply(*this, res, [&b](const _Ty& val){return val + b;});
-    return res;
+    internal::stride_walk(_sizes, internal::parallel_threads(size()), [&val](size_t n, auto dst){
+        if(dst.unit()){
+            std::fill_n(dst.ptr, n, val);
+        }else{
+            for(size_t j = 0; j < n; ++j)
+                dst[j] = val;
+        }
+    }, internal::walk_of(*this));
+
+    return *this;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
 auto Matrix<_Ty, Dim>::operator +=(const Matrix<_T, Dim>& b)-> self&{
-    return *this <= *this + b;
+    internal::mat_update<simd::add_to>(*this, b);
+    return *this;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
 auto Matrix<_Ty, Dim>::operator +=(const _T& b)-> self&{
-    return *this <= *this + b;
-}
-
-template<class _T1, class _T2, size_t Dim, std::enable_if_t<!is_matrix_v<_T1>, size_t> _ = 0>
-Matrix<decltype(std::declval<_T1>() + std::declval<_T2>()), Dim>
-operator +(const _T1& a, const Matrix<_T2, Dim>& b){
-    if(!b.is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_T1>() + std::declval<_T2>()), Dim> res(b._sizes);
-    internal::mat_apply(b, res, [&a](const _T1& val){return a + val;});
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator -(const Matrix<_T, Dim>& b) const{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");    
-
-    Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous() && b.is_continuous()){
-            simd::vec_sub(raw_begin(), b.raw_begin(), res.raw_begin(), size());
-            return res;
-        }
-    }
-
-    internal::mat_apply(*this, b, res, std::minus<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _>
-Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator -(const _T& b) const{
-    if(!is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_Ty>() - std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous()){
-            simd::vec_sub(raw_begin(), b, res.raw_begin(), size());
-            return res;
-        }
+    if constexpr(is_mat_expr_v<_T>){
+        return *this <<= *this + b;
+    }else if constexpr(is_matrix_v<_T>){
+        internal::mat_update<simd::add_to>(*this, b);
+        return *this;
+    }else{
+        internal::mat_update_scalar<simd::add_to>(*this, b);
+        return *this;
     }
-
-    internal::mat_apply(*this, res, [&b](const _Ty& val){return val - b;});
-    return res;
-}
-
-template<class _T1, class _T2, size_t Dim, std::enable_if_t<!is_matrix_v<_T1>, size_t> _ = 0>
-Matrix<decltype(std::declval<_T1>() - std::declval<_T2>()), Dim>
-operator -(const _T1& a, const Matrix<_T2, Dim>& b){
-    if(!b.is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_T1>() - std::declval<_T2>()), Dim> res(b._sizes);
-    internal::mat_apply(b, res, [&a](const _T1& val){return a - val;});
-    return res;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
 auto Matrix<_Ty, Dim>::operator -=(const Matrix<_T, Dim>& b)-> self&{
-    return *this <= *this - b;
+    internal::mat_update<simd::sub_from>(*this, b);
+    return *this;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
 auto Matrix<_Ty, Dim>::operator -=(const _T& b)-> self&{
-    return *this <= *this - b;
+    if constexpr(is_mat_expr_v<_T>){
+        return *this <<= *this - b;
+    }else if constexpr(is_matrix_v<_T>){
+        internal::mat_update<simd::sub_from>(*this, b);
+        return *this;
+    }else{
+        internal::mat_update_scalar<simd::sub_from>(*this, b);
+        return *this;
+    }
 }
 
 template<class _Ty, size_t Dim>
@@ -345,17 +346,20 @@ auto Matrix<_Ty, Dim>::operator *(const Matrix<_Ty, _N>& b) const-> self{
     size_t M = rows(), K = cols(), N = b.cols();
     Matrix<_Ty, 2> res(M, N);
 
-    if constexpr(std::is_arithmetic_v<_Ty>){
-        internal::gemm(start_ptr, b.start_ptr, res.start_ptr, 
-                        M, K, N, step(0), b.step(0), 1);
+    if constexpr(std::is_arithmetic_v<_Ty> || internal::is_half_v<_Ty>){
+        internal::gemm(start_ptr, b.start_ptr, res.start_ptr, M, K, N,
+                       step(0), step(1), b.step(0), b.step(1), res.step(0), res.step(1));
     }else{
+        size_t nth = internal::parallel_threads(M * K * N);
+        #pragma omp parallel for num_threads(nth) schedule(dynamic) if(nth > 1)
         for(size_t i = 0; i < M; ++i)
             for(size_t k = 0; k < K; ++k){
                 _Ty tmp = at(i, k);
-                pointer res_ptr = res.start_ptr + i * N;
+                pointer res_ptr = res.start_ptr + i * res.step(0);
                 pointer b_ptr = b.start_ptr + k * b._steps[0];
                 for(size_t j = 0; j < N; ++j){
-                    *res_ptr++ += tmp * *b_ptr++;
+                    *res_ptr++ += tmp * *b_ptr;
+                    b_ptr += b._steps[1];
                 }
             }
     }
@@ -370,7 +374,8 @@ auto Matrix<_Ty, Dim>::operator *(const Matrix<_Ty, 1>& b) const-> self{
     if(cols() != b.size())
         throw std::invalid_argument("shape mismatch");
     
-    return *this * b.reinterpret(b.size(), 1);
+    shape_t siz = {b.size(), 1}, stp = {b.step(0), 1};
+    return *this * self(b.start_ptr, b._raw_data, siz.begin(), stp.begin());
 }
 
 template<class _Ty, size_t Dim>
@@ -383,7 +388,7 @@ auto Matrix<_Ty, Dim>::operator *(const Matrix<_Ty, _N>& b) const-> _Ty{
     size_t siz = size();
     _Ty res = start_ptr[0] * b.start_ptr[0];
     for(size_t i = 1; i < siz; ++i)
-        res += start_ptr[i] * b.start_ptr[i];
+        res += start_ptr[i * step(0)] * b.start_ptr[i * b.step(0)];
     return res;
 }
 
@@ -395,137 +400,47 @@ auto Matrix<_Ty, Dim>::operator *(const Matrix<_Ty, 2>& b) const-> self{
     if(size() != b.rows())
         throw std::invalid_argument("shape mismatch");
     
-    return (reinterpret(1, size()) * b).reinterpret(b.cols());
+    shape_type<2> siz = {1, size()}, stp = {size() * step(0), step(0)};
+    /*the 1 x N product may have a padded row, reshaped drops the row axis without touching it.*/
+    return (Matrix<_Ty, 2>(start_ptr, _raw_data, siz.begin(), stp.begin()) * b).reshaped(b.cols());
 }
 
 template<class _Ty, size_t Dim>
 template<size_t _N, std::enable_if_t<(_N == 2) && (_N == Dim), size_t> _>
-auto Matrix<_Ty, Dim>::operator *=(const self& b) const-> self&{
+auto Matrix<_Ty, Dim>::operator *=(const self& b)-> self&{
     return *this = *this * b;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
-auto Matrix<_Ty, Dim>::operator *=(const _T& b) const-> self&{
-    return *this <= *this * b;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::mul(const Matrix<_T, Dim>& b) const{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");    
-
-    Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous() && b.is_continuous()){
-            simd::vec_mul(raw_begin(), b.raw_begin(), res.raw_begin(), size());
-            return res;
-        }
-    }
-
-    internal::mat_apply(*this, b, res, std::multiplies<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _>
-Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator *(const _T& b) const{
-    if(!is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_Ty>() * std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous()){
-            simd::vec_mul(raw_begin(), b, res.raw_begin(), size());
-            return res;
-        }
-    }
-
-    internal::mat_apply(*this, res, [&b](const _Ty& val){return val * b;});
-    return res;
-}
-
-template<class _T1, class _T2, size_t Dim, std::enable_if_t<!is_matrix_v<_T1>, size_t> _ = 0>
-Matrix<decltype(std::declval<_T1>() * std::declval<_T2>()), Dim>
-operator *(const _T1& a, const Matrix<_T2, Dim>& b){
-    if(!b.is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_T1>() * std::declval<_T2>()), Dim> res(b._sizes);
-    internal::mat_apply(b, res, [&a](const _T1& val){return a * val;});
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator /(const Matrix<_T, Dim>& b) const{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");    
-
-    Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous() && b.is_continuous()){
-            simd::vec_div(raw_begin(), b.raw_begin(), res.raw_begin(), size());
-            return res;
-        }
-    }
-
-    internal::mat_apply(*this, b, res, std::divides<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T, std::enable_if_t<!is_matrix_v<_T>, size_t> _>
-Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim>
-Matrix<_Ty, Dim>::operator /(const _T& b) const{
-    if(!is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_Ty>() / std::declval<_T>()), Dim> res(_sizes);
-
-    if constexpr(std::is_same_v<_Ty, _T> && std::is_arithmetic_v<_Ty>){
-        if(is_continuous()){
-            simd::vec_div(raw_begin(), b, res.raw_begin(), size());
-            return res;
-        }
+auto Matrix<_Ty, Dim>::operator *=(const _T& b)-> self&{
+    if constexpr(is_mat_like_v<_T>){
+        return *this = *this * b;
+    }else{
+        internal::mat_update_scalar<simd::mul_by>(*this, b);
+        return *this;
     }
-
-    internal::mat_apply(*this, res, [&b](const _Ty& val){return val / b;});
-    return res;
-}
-
-template<class _T1, class _T2, size_t Dim, std::enable_if_t<!is_matrix_v<_T1>, size_t> _ = 0>
-Matrix<decltype(std::declval<_T1>() / std::declval<_T2>()), Dim>
-operator /(const _T1& a, const Matrix<_T2, Dim>& b){
-    if(!b.is_valid())
-        throw zutil::error_invalid_use();
-
-    Matrix<decltype(std::declval<_T1>() / std::declval<_T2>()), Dim> res(b._sizes);
-    internal::mat_apply(b, res, [&a](const _T1& val){return a / val;});
-    return res;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
-auto Matrix<_Ty, Dim>::operator /=(const Matrix<_T, Dim>& b) const-> self&{
-    return *this <= *this / b;
+auto Matrix<_Ty, Dim>::operator /=(const Matrix<_T, Dim>& b)-> self&{
+    internal::mat_update<simd::div_by>(*this, b);
+    return *this;
 }
 
 template<class _Ty, size_t Dim>
 template<class _T>
-auto Matrix<_Ty, Dim>::operator /=(const _T& b) const-> self&{
-    return *this <= *this / b;
+auto Matrix<_Ty, Dim>::operator /=(const _T& b)-> self&{
+    if constexpr(is_mat_expr_v<_T>){
+        return *this <<= *this / b;
+    }else if constexpr(is_matrix_v<_T>){
+        internal::mat_update<simd::div_by>(*this, b);
+        return *this;
+    }else{
+        internal::mat_update_scalar<simd::div_by>(*this, b);
+        return *this;
+    }
 }
 
 template<class _Ty, size_t Dim>
@@ -536,7 +451,8 @@ auto Matrix<_Ty, Dim>::operator ==(const Matrix<_T, Dim>& b) const-> bool{
     if(_sizes != b._sizes)
         return false;
 
-    if constexpr(std::is_floating_point_v<_Ty> || std::is_floating_point_v<_T>){
+    if constexpr(std::is_floating_point_v<_Ty> || std::is_floating_point_v<_T>
+                 || internal::is_half_v<_Ty> || internal::is_half_v<_T>){
         return internal::mat_cmp_eps(*this, b);
     }else{
         return internal::mat_cmp(*this, b);
@@ -549,56 +465,4 @@ auto Matrix<_Ty, Dim>::operator !=(const Matrix<_T, Dim>& b) const-> bool{
     return !(*this == b);
 }
 
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>::operator <(const Matrix<_T, Dim>& b) const-> Matrix<bool, Dim>{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");
-
-    Matrix<bool, Dim> res(_sizes);
-    internal::mat_apply(*this, b, res, std::less<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>::operator <=(const Matrix<_T, Dim>& b) const-> Matrix<bool, Dim>{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");
-
-    Matrix<bool, Dim> res(_sizes);
-    internal::mat_apply(*this, b, res, std::less_equal<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>::operator >(const Matrix<_T, Dim>& b) const-> Matrix<bool, Dim>{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");
-
-    Matrix<bool, Dim> res(_sizes);
-    internal::mat_apply(*this, b, res, std::greater<>());
-    return res;
-}
-
-template<class _Ty, size_t Dim>
-template<class _T>
-auto Matrix<_Ty, Dim>::operator >=(const Matrix<_T, Dim>& b) const-> Matrix<bool, Dim>{
-    if(!is_valid()||!b.is_valid())
-        throw zutil::error_invalid_use();
-    if(_sizes != b._sizes)
-        throw std::invalid_argument("shape mismatch");
-
-    Matrix<bool, Dim> res(_sizes);
-    internal::mat_apply(*this, b, res, std::greater_equal<>());
-    return res;
-}
-    
 } // namespace zmat
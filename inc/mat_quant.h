@@ -0,0 +1,143 @@
+#pragma once
+
+#include "mat.h"
+#include "kernel/qgemm.h"
+#include <vector>
+#include <limits>
+
+namespace zmat{
+
+/*
+    Affine quantization of a matrix operand, real = scale * (q - zero_point).
+    Either member holds a single value for the whole matrix or one value per
+    row of A, or per column of B and of the result. An empty zero_point
+    means symmetric quantization (all zero).
+*/
+struct QuantParams{
+    std::vector<float> scale;
+    std::vector<int32_t> zero_point;
+};
+
+namespace internal{
+
+/*values of p for n rows or columns, broadcasting a single one.*/
+template<class _Ty>
+std::vector<_Ty> quant_expand(const std::vector<_Ty>& p, size_t n, bool allow_empty, const char* what){
+    if(p.empty() && allow_empty)
+        return std::vector<_Ty>(n, _Ty(0));
+    if(p.size() != 1 && p.size() != n)
+        throw std::invalid_argument(zutil::as_str(what, " holds ", p.size(), " values, expected 1 or ", n));
+    return p.size() == n? p: std::vector<_Ty>(n, p[0]);
+}
+
+template<class _Ta, class _Tb, class _Ep>
+void qmatmul_run(const Matrix<_Ta, 2>& a, const QuantParams& qa, const Matrix<_Tb, 2>& b, const QuantParams& qb, _Ep&& ep){
+    auto za = quant_expand(qa.zero_point, a.rows(), true, "zero_point of a");
+    auto zb = quant_expand(qb.zero_point, b.cols(), true, "zero_point of b");
+    qgemm(a.raw_begin(), b.raw_begin(), a.rows(), a.cols(), b.cols(),
+          a.step(0), a.step(1), b.step(0), b.step(1), za.data(), zb.data(), ep);
+}
+
+template<class _Ta, class _Tb>
+void qmatmul_check(const Matrix<_Ta, 2>& a, const Matrix<_Tb, 2>& b){
+    static_assert((std::is_same_v<_Ta, int8_t> || std::is_same_v<_Ta, uint8_t>)
+                  && (std::is_same_v<_Tb, int8_t> || std::is_same_v<_Tb, uint8_t>),
+                  "quantized matmul operands are int8_t or uint8_t");
+    if(!a.is_valid() || !b.is_valid())
+        throw zutil::error_invalid_use();
+    if(a.cols() != b.rows())
+        throw std::invalid_argument("shape mismatch");
+}
+
+} // namespace internal
+
+/*
+    Exact integer product of quantized matrices,
+    c[i][j] = sum_k (a[i][k] - za[i]) * (b[k][j] - zb[j]),
+    accumulated in int32. Only the zero points of qa and qb are used.
+*/
+template<class _Ta, class _Tb>
+Matrix<int32_t, 2> qmatmul_s32(const Matrix<_Ta, 2>& a, const QuantParams& qa, const Matrix<_Tb, 2>& b, const QuantParams& qb){
+    internal::qmatmul_check(a, b);
+    Matrix<int32_t, 2> res(a.rows(), b.cols());
+    int32_t* dst = res.raw_begin();
+    size_t ld = res.step(0);
+    internal::qmatmul_run(a, qa, b, qb, [&](size_t i0, size_t j0, size_t mr, size_t nr, const int32_t* tile, size_t ldt){
+        for(size_t i = 0; i < mr; ++i)
+            std::copy_n(tile + i * ldt, nr, dst + (i0 + i) * ld + j0);
+    });
+    return res;
+}
+
+/*
+    Dequantized product of quantized matrices, a per row and b per column:
+    c[i][j] = sa[i] * sb[j] * sum_k (a[i][k] - za[i]) * (b[k][j] - zb[j]).
+    The int32 sums are scaled tile by tile as they leave the kernel.
+*/
+template<class _Ta, class _Tb>
+Matrix<float, 2> qmatmul(const Matrix<_Ta, 2>& a, const QuantParams& qa, const Matrix<_Tb, 2>& b, const QuantParams& qb){
+    internal::qmatmul_check(a, b);
+    auto sa = internal::quant_expand(qa.scale, a.rows(), false, "scale of a");
+    auto sb = internal::quant_expand(qb.scale, b.cols(), false, "scale of b");
+
+    Matrix<float, 2> res(a.rows(), b.cols());
+    float* dst = res.raw_begin();
+    size_t ld = res.step(0);
+    internal::qmatmul_run(a, qa, b, qb, [&](size_t i0, size_t j0, size_t mr, size_t nr, const int32_t* tile, size_t ldt){
+        for(size_t i = 0; i < mr; ++i){
+            float s = sa[i0 + i];
+            const int32_t* src = tile + i * ldt;
+            const float* col = sb.data() + j0;
+            float* out = dst + (i0 + i) * ld + j0;
+            #pragma omp simd
+            for(size_t j = 0; j < nr; ++j)
+                out[j] = float(src[j]) * (s * col[j]);
+        }
+    });
+    return res;
+}
+
+/*
+    Requantized product: the dequantized c (see above) quantized again with
+    qc, one scale and zero point per column of c (or one for all),
+    q = saturate(round(c / sc[j]) + zc[j]), rounding half to even.
+*/
+template<class _Tc, class _Ta, class _Tb>
+Matrix<_Tc, 2> qmatmul(const Matrix<_Ta, 2>& a, const QuantParams& qa, const Matrix<_Tb, 2>& b, const QuantParams& qb, const QuantParams& qc){
+    static_assert(std::is_same_v<_Tc, int8_t> || std::is_same_v<_Tc, uint8_t>, "requantized results are int8_t or uint8_t");
+    internal::qmatmul_check(a, b);
+    size_t N = b.cols();
+    auto sa = internal::quant_expand(qa.scale, a.rows(), false, "scale of a");
+    auto sb = internal::quant_expand(qb.scale, N, false, "scale of b");
+    auto sc = internal::quant_expand(qc.scale, N, false, "scale of c");
+    auto zc = internal::quant_expand(qc.zero_point, N, true, "zero_point of c");
+
+    /*sb[j] / sc[j] and zc[j] clamped into range, folded once per column.*/
+    std::vector<float> mul(N), lo(N), hi(N);
+    for(size_t j = 0; j < N; ++j){
+        mul[j] = sb[j] / sc[j];
+        lo[j] = float(std::numeric_limits<_Tc>::min() - zc[j]);
+        hi[j] = float(std::numeric_limits<_Tc>::max() - zc[j]);
+    }
+
+    Matrix<_Tc, 2> res(a.rows(), N);
+    _Tc* dst = res.raw_begin();
+    size_t ld = res.step(0);
+    internal::qmatmul_run(a, qa, b, qb, [&](size_t i0, size_t j0, size_t mr, size_t nr, const int32_t* tile, size_t ldt){
+        for(size_t i = 0; i < mr; ++i){
+            float s = sa[i0 + i];
+            const int32_t* src = tile + i * ldt;
+            _Tc* out = dst + (i0 + i) * ld + j0;
+            #pragma omp simd
+            for(size_t j = 0; j < nr; ++j){
+                /*clamped first, so adding and removing 1.5 * 2^23 rounds to an integer without rint.*/
+                float v = std::min(std::max(float(src[j]) * (s * mul[j0 + j]), lo[j0 + j]), hi[j0 + j]);
+                v = (v + 0x1.8p23f) - 0x1.8p23f;
+                out[j] = _Tc(int32_t(v) + zc[j0 + j]);
+            }
+        }
+    });
+    return res;
+}
+
+} // namespace zmat
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "mat.h"
+
+namespace zmat{
+
+/*
+    Non-owning view of a matrix: a pointer, sizes and steps, trivially
+    copyable. Indexing it with [] or at() yields further MatRefs (or
+    element references) without touching the shared reference count,
+    which makes it the cheap way to walk nested indices on hot paths.
+    A MatRef does not keep the data alive; converting it back to a Matrix
+    re-acquires shared ownership of the data it points into.
+*/
+template<class _Ty, size_t Dim>
+class MatRef{
+    static_assert(Dim >= 1, "Dimension could not less than 1");
+
+    using self = MatRef<_Ty, Dim>;
+    using matrix_t = Matrix<std::remove_const_t<_Ty>, Dim>;
+    using index_t = ptrdiff_t;
+
+    _Ty* start_ptr = nullptr;
+    shape_type<Dim> _sizes{}, _steps{};
+    internal::MatrixData<void>* raw = nullptr;
+
+    template<class _Other, size_t _N>
+    friend class MatRef;
+
+    template<class _Other, size_t _N>
+    friend class Matrix;
+
+public:
+    using value_type = std::remove_const_t<_Ty>;
+    using reference = _Ty&;
+    using sub_type = std::conditional_t<Dim == 1, reference, MatRef<_Ty, Dim - 1>>;
+
+    template<size_t _N>
+    using sub_type_of = std::conditional_t<Dim == _N, reference, MatRef<_Ty, Dim - _N>>;
+
+    MatRef() = default;
+
+    bool is_valid() const{
+        return start_ptr != nullptr;
+    }
+
+    size_t size(size_t index) const{
+        return _sizes[index];
+    }
+
+    size_t size() const{
+        size_t tot = 1;
+        for(auto i: _sizes)
+            tot *= i;
+        return tot;
+    }
+
+    size_t step(size_t index) const{
+        return _steps[index];
+    }
+
+    _Ty* data() const{
+        return start_ptr;
+    }
+
+    sub_type operator[](index_t idx) const{
+        if(!is_valid())
+            throw zutil::error_invalid_use();
+        if(idx < 0)
+            idx += size(0);
+        if(idx >= size(0) || idx < 0)
+            throw zutil::error_out_of_range(idx, size(0));
+        return sub<1>(start_ptr + idx * step(0));
+    }
+
+    template<class ...Types, std::enable_if_t<(sizeof...(Types) <= Dim), size_t> _ = 0>
+    sub_type_of<sizeof...(Types)> at(Types ...indices) const{
+        constexpr size_t arg_cnt = sizeof...(Types);
+        static_assert((std::is_convertible_v<Types, index_t> && ...), "Index should be size type.");
+
+        if(!is_valid())
+            throw zutil::error_invalid_use();
+
+        index_t idx[] = {static_cast<index_t>(indices)...};
+        auto ptr = start_ptr;
+        for(size_t i = 0; i < arg_cnt; ++i){
+            if(idx[i] < 0)
+                idx[i] += size(i);
+            if(idx[i] >= size(i) || idx[i] < 0)
+                throw zutil::error_out_of_range(idx[i], size(i));
+            ptr += idx[i] * step(i);
+        }
+        return sub<arg_cnt>(ptr);
+    }
+
+    /*owning Matrix view of the same elements.*/
+    matrix_t to_matrix() const{
+        if(!is_valid())
+            throw zutil::error_invalid_use();
+        return matrix_t(const_cast<value_type*>(start_ptr), raw->shared_from_this(), _sizes.begin(), _steps.begin());
+    }
+
+    operator matrix_t() const{
+        return to_matrix();
+    }
+
+private:
+    template<size_t _N>
+    sub_type_of<_N> sub(_Ty* ptr) const{
+        if constexpr(_N == Dim){
+            return *ptr;
+        }else{
+            MatRef<_Ty, Dim - _N> res;
+            res.start_ptr = ptr;
+            std::copy(_sizes.begin() + _N, _sizes.end(), res._sizes.begin());
+            std::copy(_steps.begin() + _N, _steps.end(), res._steps.begin());
+            res.raw = raw;
+            return res;
+        }
+    }
+};
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::ref()-> MatRef<_Ty, Dim>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    MatRef<_Ty, Dim> res;
+    res.start_ptr = start_ptr;
+    res._sizes = _sizes;
+    res._steps = _steps;
+    res.raw = _raw_data.get();
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+auto Matrix<_Ty, Dim>::ref() const-> MatRef<const _Ty, Dim>{
+    if(!is_valid())
+        throw zutil::error_invalid_use();
+    MatRef<const _Ty, Dim> res;
+    res.start_ptr = start_ptr;
+    res._sizes = _sizes;
+    res._steps = _steps;
+    res.raw = _raw_data.get();
+    return res;
+}
+
+template<class _Ty, size_t Dim>
+std::ostream& operator <<(std::ostream& out, const MatRef<_Ty, Dim>& mat){
+    return out << mat.to_matrix();
+}
+
+} // namespace zmat
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mat.h"
+#include "mat_ops.h"
+#include <cmath>
+#include <algorithm>
+
+namespace zmat{
+
+namespace internal{
+
+/*edge of the square tiles: five of them (A, B, C and the next A and B) fit in budget bytes.*/
+template<class _Ty>
+size_t gemm_tile_size(size_t budget){
+    size_t t = static_cast<size_t>(std::sqrt(static_cast<double>(budget / sizeof(_Ty)) / 5));
+    return std::max<size_t>(t, 1);
+}
+
+} // namespace internal
+
+/*
+    c = a * b for operands that need not fit in memory, typically file-backed
+    matrices from Matrix::map_file. The product is computed tile by tile, each
+    C tile accumulated over the K tiles of its row of A and column of B. While
+    a tile is multiplied the next pair is prefetched with will_need, and tiles
+    are released with dont_need once used, which keeps the resident operand
+    data within budget bytes (mat_get_memory_budget() by default).
+    c has to be allocated with the result shape and must not overlap a or b.
+*/
+template<class _Ty>
+void gemm_out_of_core(const Matrix<_Ty, 2>& a, const Matrix<_Ty, 2>& b, Matrix<_Ty, 2>& c, size_t budget = 0){
+    static_assert(std::is_arithmetic_v<_Ty> || internal::is_half_v<_Ty>, "out-of-core gemm only supports arithmetic types");
+
+    if(!a.is_valid() || !b.is_valid() || !c.is_valid())
+        throw zutil::error_invalid_use();
+    if(a.cols() != b.rows() || c.rows() != a.rows() || c.cols() != b.cols())
+        throw std::invalid_argument("shape mismatch");
+    if(internal::mat_overlap(c, a) || internal::mat_overlap(c, b)
+        || c.raw_begin() == a.raw_begin() || c.raw_begin() == b.raw_begin())
+        throw std::invalid_argument("the result overlaps an operand");
+
+    size_t M = a.rows(), K = a.cols(), N = b.cols();
+    size_t T = internal::gemm_tile_size<_Ty>(budget? budget: mat_get_memory_budget());
+    size_t tm = std::min(T, M), tk = std::min(T, K), tn = std::min(T, N);
+
+    using index_t = typename Matrix<_Ty, 2>::index_t;
+    auto tile = [](const Matrix<_Ty, 2>& m, size_t i, size_t ti, size_t j, size_t tj){
+        return m.view(index_t(i), index_t(std::min(i + ti, m.rows()) - 1),
+                      index_t(j), index_t(std::min(j + tj, m.cols()) - 1));
+    };
+
+    a.view(0, tm - 1, 0, tk - 1).will_need();
+    b.view(0, tk - 1, 0, tn - 1).will_need();
+
+    for(size_t i = 0; i < M; i += tm)
+        for(size_t j = 0; j < N; j += tn){
+            auto ct = tile(c, i, tm, j, tn);
+            ct <<= _Ty(0);
+
+            for(size_t k = 0; k < K; k += tk){
+                auto at = tile(a, i, tm, k, tk);
+                auto bt = tile(b, k, tk, j, tn);
+
+                /*next pair in loop order, read in the background while this one is multiplied.*/
+                size_t ni = i, nj = j, nk = k + tk;
+                if(nk >= K){
+                    nk = 0;
+                    nj += tn;
+                    if(nj >= N){
+                        nj = 0;
+                        ni += tm;
+                    }
+                }
+                if(ni < M){
+                    tile(a, ni, tm, nk, tk).will_need();
+                    tile(b, nk, tk, nj, tn).will_need();
+                }
+
+                internal::gemm(at.raw_begin(), bt.raw_begin(), ct.raw_begin(),
+                               at.rows(), at.cols(), bt.cols(),
+                               at.step(0), at.step(1), bt.step(0), bt.step(1), ct.step(0), ct.step(1));
+
+                if(ni != i || nk != k)
+                    at.dont_need();
+                bt.dont_need();
+            }
+            ct.dont_need();
+        }
+}
+
+} // namespace zmat
@@ -2,4 +2,12 @@
 
 #include "mat_impl.h"
 #include "mat_ops.h"
-#include "mat_func.h"
\ No newline at end of file
+#include "mat_expr.h"
+#include "mat_func.h"
+#include "mat_mask.h"
+#include "mat_ref.h"
+#include "mat_io.h"
+#include "smat.h"
+#include "mat_tiled.h"
+#include "mat_quant.h"
+#include "mat_batch.h"
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "mat.h"
+#include <utility>
+#include <initializer_list>
+
+namespace zmat{
+
+namespace internal{
+
+template<class _Fn, size_t ..._Is>
+constexpr void static_for_impl(_Fn& fn, std::index_sequence<_Is...>){
+    (fn(std::integral_constant<size_t, _Is>()), ...);
+}
+
+/*call fn(integral_constant<size_t, i>) for i in [0, _N), unrolled at compile time.*/
+template<size_t _N, class _Fn>
+constexpr void static_for(_Fn fn){
+    static_for_impl(fn, std::make_index_sequence<_N>());
+}
+
+} // namespace internal
+
+/*
+    Matrix with compile-time extents and inline storage. No allocation and
+    no reference counting; every operation is unrolled and usable in
+    constant expressions. view() exposes the storage as a Matrix view, which
+    is only valid while the SMatrix is alive.
+*/
+template<class _Ty, size_t _R, size_t _C>
+class SMatrix{
+    static_assert(_R >= 1 && _C >= 1, "Matrix size cannot be zero");
+
+    using self = SMatrix<_Ty, _R, _C>;
+
+    _Ty _data[_R * _C]{};
+
+public:
+    using value_type = _Ty;
+    using pointer = _Ty*;
+    using reference = _Ty&;
+
+    constexpr SMatrix() = default;
+
+    constexpr explicit SMatrix(const _Ty& val){
+        internal::static_for<_R * _C>([&](auto i){ _data[i] = val; });
+    }
+
+    /*missing trailing elements are value-initialized, as in Matrix.*/
+    constexpr SMatrix(std::initializer_list<std::initializer_list<_Ty>> init_vals){
+        if(init_vals.size() > _R)
+            throw std::invalid_argument("too many rows for the matrix size");
+        size_t i = 0;
+        for(const auto& row: init_vals){
+            if(row.size() > _C)
+                throw std::invalid_argument("too many columns for the matrix size");
+            size_t j = 0;
+            for(const auto& val: row)
+                _data[i * _C + j++] = val;
+            ++i;
+        }
+    }
+
+    /*copy from a Matrix or a view of the same shape.*/
+    template<class _T>
+    explicit SMatrix(const Matrix<_T, 2>& mat){
+        *this = mat;
+    }
+
+    template<class _T>
+    self& operator =(const Matrix<_T, 2>& mat){
+        if(!mat.is_valid())
+            throw zutil::error_invalid_use();
+        if(mat.size(0) != _R || mat.size(1) != _C)
+            throw std::invalid_argument("shape mismatch");
+        for(size_t i = 0; i < _R; ++i)
+            for(size_t j = 0; j < _C; ++j)
+                _data[i * _C + j] = mat.raw_begin()[i * mat.step(0) + j * mat.step(1)];
+        return *this;
+    }
+
+    static constexpr self zeros(){
+        return self(_Ty(0));
+    }
+
+    static constexpr self ones(){
+        return self(_Ty(1));
+    }
+
+    template<size_t _N = _R, std::enable_if_t<(_N == _C), size_t> _ = 0>
+    static constexpr self eye(){
+        self res(_Ty(0));
+        internal::static_for<_R>([&](auto i){ res._data[i * (_C + 1)] = _Ty(1); });
+        return res;
+    }
+
+    static constexpr size_t rows(){
+        return _R;
+    }
+
+    static constexpr size_t cols(){
+        return _C;
+    }
+
+    static constexpr size_t size(){
+        return _R * _C;
+    }
+
+    static constexpr size_t size(size_t index){
+        return index == 0? _R: _C;
+    }
+
+    constexpr pointer data(){
+        return _data;
+    }
+
+    constexpr const _Ty* data() const{
+        return _data;
+    }
+
+    /*unchecked, m[i][j].*/
+    constexpr pointer operator[](size_t i){
+        return _data + i * _C;
+    }
+
+    constexpr const _Ty* operator[](size_t i) const{
+        return _data + i * _C;
+    }
+
+    constexpr reference operator()(size_t i, size_t j){
+        return _data[i * _C + j];
+    }
+
+    constexpr const _Ty& operator()(size_t i, size_t j) const{
+        return _data[i * _C + j];
+    }
+
+    constexpr reference at(size_t i, size_t j){
+        if(i >= _R)
+            throw zutil::error_out_of_range(i, _R);
+        if(j >= _C)
+            throw zutil::error_out_of_range(j, _C);
+        return _data[i * _C + j];
+    }
+
+    constexpr const _Ty& at(size_t i, size_t j) const{
+        return const_cast<self&>(*this).at(i, j);
+    }
+
+    /*Matrix view over the inline storage.*/
+    Matrix<_Ty, 2> view(){
+        shape_type<2> sizes = {_R, _C}, steps = {_C, 1};
+        auto raw = std::make_shared<internal::BorrowedData<_Ty>>(size(), _data);
+        return Matrix<_Ty, 2>(_data, raw, sizes.begin(), steps.begin());
+    }
+
+    const Matrix<_Ty, 2> view() const{
+        return const_cast<self&>(*this).view();
+    }
+
+    /*owning copy as a Matrix.*/
+    Matrix<_Ty, 2> to_matrix() const{
+        return view().clone();
+    }
+
+    constexpr SMatrix<_Ty, _C, _R> transposed() const{
+        SMatrix<_Ty, _C, _R> res;
+        internal::static_for<_R * _C>([&](auto k){
+            res(k % _C, k / _C) = _data[k];
+        });
+        return res;
+    }
+
+    template<size_t _K>
+    constexpr SMatrix<_Ty, _R, _K> operator *(const SMatrix<_Ty, _C, _K>& b) const{
+        SMatrix<_Ty, _R, _K> res;
+        internal::static_for<_R * _K>([&](auto k){
+            constexpr size_t i = k / _K, j = k % _K;
+            _Ty sum = _data[i * _C] * b(0, j);
+            internal::static_for<_C - 1>([&](auto t){
+                sum += _data[i * _C + t + 1] * b(t + 1, j);
+            });
+            res(i, j) = sum;
+        });
+        return res;
+    }
+
+    constexpr self operator +(const self& b) const{
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = _data[k] + b._data[k]; });
+        return res;
+    }
+
+    constexpr self operator -(const self& b) const{
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = _data[k] - b._data[k]; });
+        return res;
+    }
+
+    constexpr self operator -() const{
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = -_data[k]; });
+        return res;
+    }
+
+    constexpr self operator *(const _Ty& val) const{
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = _data[k] * val; });
+        return res;
+    }
+
+    friend constexpr self operator *(const _Ty& val, const self& mat){
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = val * mat._data[k]; });
+        return res;
+    }
+
+    constexpr self operator /(const _Ty& val) const{
+        self res;
+        internal::static_for<_R * _C>([&](auto k){ res._data[k] = _data[k] / val; });
+        return res;
+    }
+
+    constexpr self& operator +=(const self& b){
+        internal::static_for<_R * _C>([&](auto k){ _data[k] += b._data[k]; });
+        return *this;
+    }
+
+    constexpr self& operator -=(const self& b){
+        internal::static_for<_R * _C>([&](auto k){ _data[k] -= b._data[k]; });
+        return *this;
+    }
+
+    constexpr self& operator *=(const _Ty& val){
+        internal::static_for<_R * _C>([&](auto k){ _data[k] *= val; });
+        return *this;
+    }
+
+    template<size_t _N = _R, std::enable_if_t<(_N == _C), size_t> _ = 0>
+    constexpr self& operator *=(const self& b){
+        return *this = *this * b;
+    }
+
+    constexpr self& operator /=(const _Ty& val){
+        internal::static_for<_R * _C>([&](auto k){ _data[k] /= val; });
+        return *this;
+    }
+
+    constexpr bool operator ==(const self& b) const{
+        bool res = true;
+        internal::static_for<_R * _C>([&](auto k){ res = res && _data[k] == b._data[k]; });
+        return res;
+    }
+
+    constexpr bool operator !=(const self& b) const{
+        return !(*this == b);
+    }
+
+    friend std::ostream& operator <<(std::ostream& out, const self& mat){
+        mat.view().print(out);
+        return out;
+    }
+};
+
+} // namespace zmat
@@ -1,6 +1,8 @@
 #include "matrix.h"
 #include<algorithm>
 #include<complex>
+#include<filesystem>
+#include<fstream>
 using namespace std;
 using zmat::Matrix;
 using zmat::Mat;
@@ -95,6 +97,226 @@ void print_msg(T a){
     cout << "view: " << a.is_view() << endl;
 }
 
+/*
+    qmatmul_s32 against the scalar definition for one pair of operand types,
+    false on any mismatch. narrow keeps the values within [-64, 64) of the
+    type's midpoint, which the kernels multiply by a faster path.
+*/
+template<class Ta, class Tb>
+bool check_qmatmul(size_t M, size_t K, size_t N, bool narrow){
+    Mat<Ta> a(M, K);
+    Mat<Tb> b(K, N);
+    unsigned seed = 12345;
+    auto next = [&seed](){
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 16;
+    };
+    auto value = [&](bool is_signed){
+        int v = narrow? int(next() % 128) - 64: int(next() % 256) - 128;
+        return is_signed? v: v + 128;
+    };
+    a.apply([&](Ta& x){ x = Ta(value(std::is_signed_v<Ta>)); });
+    b.apply([&](Tb& x){ x = Tb(value(std::is_signed_v<Tb>)); });
+
+    zmat::QuantParams qa, qb;
+    for(size_t i = 0; i < M; ++i)
+        qa.zero_point.push_back(int32_t(next() % 256) - (std::is_signed_v<Ta>? 128: 0));
+    qb.zero_point = {std::is_signed_v<Tb>? -3: 131};
+
+    auto c = zmat::qmatmul_s32(a, qa, b, qb);
+    for(size_t i = 0; i < M; ++i)
+        for(size_t j = 0; j < N; ++j){
+            int32_t ref = 0;
+            for(size_t k = 0; k < K; ++k)
+                ref += (int32_t(a.at(i, k)) - qa.zero_point[i]) * (int32_t(b.at(k, j)) - qb.zero_point[0]);
+            if(c.at(i, j) != ref)
+                return false;
+        }
+    return true;
+}
+
+template<class T>
+T value_of(size_t x){
+    if constexpr(is_same_v<T, string>)
+        return to_string(x);
+    else
+        return T(x);
+}
+
+/*a.transpose() of a fresh M x N matrix, once against the elements and twice against the original.*/
+template<class T>
+bool check_transpose(size_t M, size_t N){
+    Mat<T> a(M, N);
+    for(size_t i = 0; i < M; ++i)
+        for(size_t j = 0; j < N; ++j)
+            a.at(i, j) = value_of<T>(i * N + j);
+    auto orig = a.clone();
+
+    a.transpose();
+    if(a.rows() != N || a.cols() != M)
+        return false;
+    for(size_t i = 0; i < M; ++i)
+        for(size_t j = 0; j < N; ++j)
+            if(a.at(j, i) != orig.at(i, j))
+                return false;
+    a.transpose();
+    return a == orig;
+}
+
+/*the same for an n x n view at (r, c) of a larger matrix, through t() when strided; the rest must stay.*/
+template<class T>
+bool check_transpose_view(size_t n, size_t r, size_t c, bool strided){
+    Mat<T> m(r + n + 3, c + n + 5);
+    for(size_t i = 0; i < m.rows(); ++i)
+        for(size_t j = 0; j < m.cols(); ++j)
+            m.at(i, j) = value_of<T>(i * m.cols() + j);
+    auto orig = m.clone();
+
+    using index_t = typename Mat<T>::index_t;
+    auto v = m.view(index_t(r), index_t(r + n - 1), index_t(c), index_t(c + n - 1));
+    if(strided)
+        v = v.t();
+    v.transpose();
+    for(size_t i = 0; i < m.rows(); ++i)
+        for(size_t j = 0; j < m.cols(); ++j){
+            bool inside = i >= r && i < r + n && j >= c && j < c + n;
+            if(m.at(i, j) != (inside? orig.at(r + j - c, c + i - r): orig.at(i, j)))
+                return false;
+        }
+    v.transpose();
+    return m == orig;
+}
+
+/*astype<U>(mode) of the values in, repeated past a few vector widths, against expect.*/
+template<class U, class T>
+bool check_cast(const vector<T>& in, const vector<U>& expect, int mode){
+    size_t n = in.size() * 9;
+    Vector<T> a(n);
+    for(size_t i = 0; i < n; ++i)
+        a.at(i) = in[i % in.size()];
+    auto b = a.template astype<U>(mode);
+    for(size_t i = 0; i < n; ++i)
+        if(b.at(i) != expect[i % in.size()])
+            return false;
+    return true;
+}
+
+/*
+    vals go to H and back to float one at a time and through the bulk
+    astype loops, both have to give back expect (NaN has to stay NaN).
+*/
+template<class H>
+bool check_half_roundtrip(const vector<float>& vals, const vector<float>& expect){
+    size_t n = vals.size() * 9;
+    Vector<float> a(n);
+    for(size_t i = 0; i < n; ++i)
+        a.at(i) = vals[i % vals.size()];
+    auto h = a.template astype<H>();
+    auto back = h.template astype<float>();
+    for(size_t i = 0; i < n; ++i){
+        float e = expect[i % vals.size()], one = float(H(a.at(i)));
+        if(e != e){
+            if(one == one || back.at(i) == back.at(i))
+                return false;
+        }else if(one != e || back.at(i) != e || h.at(i).bits != H(e).bits){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    gemm of small integers, exact in float, so the H result has to be the
+    float reference rounded once, whatever the number of KC panels.
+*/
+template<class H>
+bool check_half_gemm(size_t M, size_t K, size_t N){
+    Mat<H> a(M, K), b(K, N);
+    Mat<float> fa(M, K), fb(K, N);
+    for(size_t i = 0; i < M; ++i)
+        for(size_t k = 0; k < K; ++k)
+            fa.at(i, k) = a.at(i, k) = float(int((i * 7 + k * 3) % 5) - 2);
+    for(size_t k = 0; k < K; ++k)
+        for(size_t j = 0; j < N; ++j)
+            fb.at(k, j) = b.at(k, j) = float(int((k * 5 + j) % 7) - 3);
+    Mat<H> c = a * b;
+    for(size_t i = 0; i < M; ++i)
+        for(size_t j = 0; j < N; ++j){
+            float ref = 0;
+            for(size_t k = 0; k < K; ++k)
+                ref += fa.at(i, k) * fb.at(k, j);
+            if(c.at(i, j).bits != H(ref).bits)
+                return false;
+        }
+    return true;
+}
+
+/*fills m with small integers, products of them stay exact in any arithmetic type.*/
+template<class T, size_t D>
+void fill_small(Matrix<T, D>& m, int seed){
+    int k = seed;
+    for(auto& v: m)
+        v = T((k++ * 7 + seed) % 9 - 4);
+}
+
+/*bmm(a, b) against the 2-D product of every pair of entries, a 2-D operand pairs with each entry.*/
+template<class T, size_t Da, size_t Db>
+bool check_bmm(const Matrix<T, Da>& a, const Matrix<T, Db>& b){
+    auto c = zmat::bmm(a, b);
+    for(size_t i = 0; i < c.size(0); ++i){
+        Mat<T> ai, bi;
+        if constexpr(Da == 3)
+            ai = a[i];
+        else
+            ai = a;
+        if constexpr(Db == 3)
+            bi = b[i];
+        else
+            bi = b;
+        Mat<T> ref = ai * bi;
+        if(!(Mat<T>(c[i]) == ref))
+            return false;
+    }
+    return true;
+}
+
+/*
+    a * b, a.t() * b and a * b.t() of M x K and K x N small integers
+    against a plain triple loop, exact for every type tried.
+*/
+template<class T>
+bool check_gemm(size_t M, size_t K, size_t N){
+    Mat<T> a(M, K), b(K, N), at(K, M), bt(N, K);
+    fill_small(a, int(M));
+    fill_small(b, int(N));
+    for(size_t i = 0; i < M; ++i)
+        for(size_t k = 0; k < K; ++k)
+            at.at(k, i) = a.at(i, k);
+    for(size_t k = 0; k < K; ++k)
+        for(size_t j = 0; j < N; ++j)
+            bt.at(j, k) = b.at(k, j);
+
+    Mat<T> ref(M, N, T(0));
+    for(size_t i = 0; i < M; ++i)
+        for(size_t k = 0; k < K; ++k)
+            for(size_t j = 0; j < N; ++j)
+                ref.at(i, j) += a.at(i, k) * b.at(k, j);
+
+    Mat<T> c = a * b, ct = at.t() * b, cbt = a * bt.t();
+    return c == ref && ct == ref && cbt == ref;
+}
+
+/*true when fn() throws E with what() containing msg.*/
+template<class E, class F>
+bool throws_with(F fn, const string& msg){
+    try{
+        fn();
+    }catch(const E& e){
+        return string(e.what()).find(msg) != string::npos;
+    }
+    return false;
+}
+
 #include<ctime>
 int main(){
 #define PRINT(a) cout << #a << ": " << a << endl;
@@ -102,6 +324,12 @@ int main(){
     catch(std::exception& e){\
         cout << "exception: " << e.what() << endl;\
     }
+    int failures = 0;
+#define CHECK(cond)\
+    if(!(cond)){\
+        cout << "check failed: " << #cond << endl;\
+        ++failures;\
+    }
 
     {
         cout << "**************part1 info************" << endl;
@@ -352,4 +580,564 @@ int main(){
         PRINT(d);
         PRINT(c * d);
     }
-}
\ No newline at end of file
+
+    {
+        cout << "**************part9 Row Padding************" << endl;
+        zmat::mat_set_row_padding(true);
+
+        auto a = Mat<double>::eye(3);
+        PRINT(a);
+        CHECK(a.step(0) != a.cols());
+        for(size_t i = 0; i < 3; ++i)
+            for(size_t j = 0; j < 3; ++j)
+                CHECK(a.at(i, j) == (i == j));
+
+        Mat<complex<double>> c(3, 3, 1, 1), d(3, 3, 2, 0);
+        auto cd = c * d;
+        PRINT(cd);
+        for(auto& val: cd)
+            CHECK(val == complex<double>(6, 6));
+
+        Vector<double> v = {1, 2, 3};
+        Mat<double> m = {{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}};
+        auto vm = v * m;
+        PRINT(vm);
+        CHECK(vm.size() == 4);
+        for(size_t j = 0; j < 4; ++j)
+            CHECK(vm.at(j) == m.at(0, j) + 2 * m.at(1, j) + 3 * m.at(2, j));
+
+        /*every path that allocates a new 2-D matrix pads it.*/
+        Mat<double> p = {{1, 2, 3}, {4, 5, 6}};
+        Mat<double> q = p + p;
+        auto pc = p.clone();
+        CHECK(p.step(0) == 8 && q.step(0) == 8 && pc.step(0) == 8);
+        CHECK(q == Mat<double>({{2, 4, 6}, {8, 10, 12}}));
+        CHECK(pc == p);
+        CHECK(p.t().clone() == p.transposed());
+        CHECK(p.reshaped(3, 2).step(0) == 8);
+        CHECK(p.reshaped(3, 2) == Mat<double>({{1, 2}, {3, 4}, {5, 6}}));
+
+        Mat<string> ps(3, 3, "s");
+        auto psc = ps.t().clone();
+        CHECK(psc.step(0) != psc.cols() && psc == Mat<string>(3, 3, "s"));
+
+        zmat::mat_set_row_padding(false);
+    }
+
+    {
+        cout << "**************part10 Masks************" << endl;
+        Mat<int> a = {{1, 2}, {3, -4}};
+        Mat<double> b = {{0.1, 0.2}, {0.3, 0.4}};
+
+        PRINT(((a + b) < 0.5));
+        CHECK(((a + b) < 0.5).count() == 1);
+        CHECK((a > 1e20).count() == 0);
+        CHECK((a > -1e20).count() == 4);
+        CHECK((a < std::nan("")).count() == 0);
+        CHECK((a > 2.5).count() == 1);
+    }
+
+    {
+        cout << "**************part11 Quantized Matmul************" << endl;
+        auto best = zmat::mat_get_simd_level();
+        for(int lv = zmat::SIMD_GENERIC; lv <= best; ++lv){
+            zmat::mat_set_simd_level(zmat::SimdLevel(lv));
+            cout << zmat::mat_simd_level_name(zmat::SimdLevel(lv)) << endl;
+            for(size_t K: {1, 7, 61, 258})
+                for(bool narrow: {false, true}){
+                    CHECK((check_qmatmul<int8_t, int8_t>(37, K, 45, narrow)));
+                    CHECK((check_qmatmul<int8_t, uint8_t>(37, K, 45, narrow)));
+                    CHECK((check_qmatmul<uint8_t, int8_t>(37, K, 45, narrow)));
+                    CHECK((check_qmatmul<uint8_t, uint8_t>(37, K, 45, narrow)));
+                }
+        }
+        zmat::mat_set_simd_level(best);
+    }
+
+    {
+        cout << "**************part12 Transpose************" << endl;
+        for(bool pad: {false, true}){
+            zmat::mat_set_row_padding(pad);
+            cout << "row padding: " << pad << endl;
+            for(size_t n: {1, 5, 33, 100}){
+                CHECK(check_transpose<float>(n, n));
+                CHECK(check_transpose<int8_t>(n, n));
+            }
+            for(auto [M, N]: {pair<size_t, size_t>{1, 7}, {6, 4}, {5, 3}, {64, 48}, {100, 70}, {37, 200}}){
+                CHECK(check_transpose<float>(M, N));
+                CHECK(check_transpose<double>(M, N));
+                CHECK(check_transpose<int8_t>(M, N));
+                CHECK(check_transpose<string>(M, N));
+            }
+            for(bool strided: {false, true}){
+                CHECK(check_transpose_view<float>(40, 1, 2, strided));
+                CHECK(check_transpose_view<double>(7, 3, 0, strided));
+            }
+
+            /*a matrix whose data is shared is replaced by a transposed copy, the other owner keeps its data.*/
+            Mat<float> a = {{1, 2, 3}, {4, 5, 6}};
+            auto b = a;
+            a.transpose();
+            CHECK(a == Mat<float>({{1, 4}, {2, 5}, {3, 6}}));
+            CHECK(b == Mat<float>({{1, 2, 3}, {4, 5, 6}}));
+
+            /*transposed() lays its result out like any new matrix.*/
+            auto c = b.transposed();
+            CHECK(c.step(0) == zmat::internal::padded_pitch(2, sizeof(float)));
+            CHECK(c == a);
+
+            /*a move-constructed matrix is flagged as a view, so only a square one transposes.*/
+            Mat<float> d(std::move(c));
+            CHECK(d.is_view());
+            bool thrown = false;
+            try{ d.transpose(); }catch(const std::logic_error&){ thrown = true; }
+            CHECK(thrown);
+        }
+        zmat::mat_set_row_padding(false);
+    }
+
+    {
+        cout << "**************part13 Broadcasting************" << endl;
+        Mat<double> a = {{1, 2, 3}, {4, 5, 6}};
+        Vector<double> row = {1, 2, 4};
+        Mat<double> col = {{1}, {2}};
+
+        PRINT((a + row));
+        CHECK((a + row) == Mat<double>({{2, 4, 7}, {5, 7, 10}}));
+        CHECK((a - row) == Mat<double>({{0, 0, -1}, {3, 3, 2}}));
+        CHECK((a / row) == Mat<double>({{1, 1, 0.75}, {4, 2.5, 1.5}}));
+        CHECK(a.mul(row) == Mat<double>({{1, 4, 12}, {4, 10, 24}}));
+        CHECK((a + col) == Mat<double>({{2, 3, 4}, {6, 7, 8}}));
+        CHECK((a - col) == Mat<double>({{0, 1, 2}, {2, 3, 4}}));
+        CHECK((a / col) == Mat<double>({{1, 2, 3}, {2, 2.5, 3}}));
+        CHECK(a.mul(col) == Mat<double>({{1, 2, 3}, {8, 10, 12}}));
+        PRINT((col + row));
+        CHECK((col + row) == Mat<double>({{2, 3, 5}, {3, 4, 6}}));
+
+        /*in-place forms take lower-rank operands too.*/
+        auto b = a.clone();
+        b += row;
+        CHECK(b == a + row);
+        b -= col;
+        CHECK(b == a + row - col);
+        b /= row;
+        CHECK(b == (a + row - col) / row);
+        b <<= row;
+        CHECK(b == Mat<double>({{1, 2, 4}, {1, 2, 4}}));
+
+        /*operands that alias the destination are read before it is written.*/
+        auto c = a.clone();
+        c += c.row_view(0);
+        CHECK(c == Mat<double>({{2, 4, 6}, {5, 7, 9}}));
+        c = a.clone();
+        c <<= c.row_view(1);
+        CHECK(c == Mat<double>({{4, 5, 6}, {4, 5, 6}}));
+        Mat<double> s = {{1, 2}, {3, 4}};
+        s <<= s.t();
+        CHECK(s == Mat<double>({{1, 3}, {2, 4}}));
+
+        /*comparisons broadcast both operands.*/
+        CHECK((row < a).count() == 3);
+        CHECK((col < row).count() == 3);
+        CHECK((a > col).count() == 5);
+
+        bool thrown = false;
+        try{
+            auto x = a + Vector<double>{1, 2};
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        CHECK(thrown);
+        thrown = false;
+        try{
+            a += Mat<double>(3, 1, 1.0);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        CHECK(thrown);
+        thrown = false;
+        try{
+            auto m = a < Vector<double>{1, 2};
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    {
+        cout << "**************part14 Casts************" << endl;
+        using lim32 = numeric_limits<int32_t>;
+        using lim64 = numeric_limits<int64_t>;
+        const float finf = numeric_limits<float>::infinity();
+        const double dinf = numeric_limits<double>::infinity();
+        const float fnan = numeric_limits<float>::quiet_NaN();
+
+        /*float -> int32 saturates at the float values closest to the int range.*/
+        CHECK((check_cast<int32_t, float>({3e9f, -3e9f, 2147483648.0f, -2147483648.0f, 2147483520.0f, finf, -finf, 7.9f},
+                                          {lim32::max(), lim32::min(), lim32::max(), lim32::min(), 2147483520, lim32::max(), lim32::min(), 7},
+                                          zmat::CAST_SATURATE)));
+        CHECK((check_cast<int64_t, double>({1e19, -1e19, 9223372036854775808.0, -9223372036854775808.0, dinf, -dinf, -3.5},
+                                           {lim64::max(), lim64::min(), lim64::max(), lim64::min(), lim64::max(), lim64::min(), -3},
+                                           zmat::CAST_SATURATE)));
+        CHECK((check_cast<uint8_t, float>({255.5f, 254.5f, 256.0f, -1.0f, fnan, 0.5f, 1.5f, 2.5f, -0.4f},
+                                          {255, 254, 255, 0, 0, 0, 2, 2, 0},
+                                          zmat::CAST_ROUND | zmat::CAST_SATURATE)));
+        CHECK((check_cast<int32_t, uint32_t>({4294967295u, 2147483648u, 2147483647u, 5u},
+                                             {lim32::max(), lim32::max(), lim32::max(), 5},
+                                             zmat::CAST_SATURATE)));
+        /*round half to even.*/
+        CHECK((check_cast<int32_t, float>({0.5f, 1.5f, 2.5f, -0.5f, -1.5f, -2.5f, 3.49f},
+                                          {0, 2, 2, 0, -2, -2, 3},
+                                          zmat::CAST_ROUND)));
+        CHECK((check_cast<int64_t, double>({0.5, 1.5, 2.5, -0.5, -1.5, -2.5, 4503599627370497.0},
+                                           {0, 2, 2, 0, -2, -2, 4503599627370497},
+                                           zmat::CAST_ROUND)));
+
+        /*the result is laid out like any new matrix, rows padded.*/
+        Mat<float> m(3, 3);
+        for(size_t i = 0; i < 9; ++i)
+            m.at(i / 3, i % 3) = 0.5f + float(i);
+        auto md = m.astype<int32_t>(zmat::CAST_ROUND);
+        CHECK(md.step(0) == zmat::internal::padded_pitch(3, sizeof(int32_t)));
+        CHECK(md.at(2, 1) == 8 && md.at(1, 0) == 4 && md.at(0, 1) == 2);
+    }
+
+    {
+        cout << "**************part15 Half Floats************" << endl;
+        using zmat::float16;
+        using zmat::bfloat16;
+        const float nan = numeric_limits<float>::quiet_NaN();
+
+        /*max, the smallest subnormal, a value rounding to even, overflow to inf, NaN.*/
+        CHECK(check_half_roundtrip<float16>({65504.0f, 0x1p-24f, 0x1p-25f * 3, 1.0f + 0x1p-11f, 65520.0f, -2.5f, nan},
+                                            {65504.0f, 0x1p-24f, 0x1p-23f, 1.0f, numeric_limits<float>::infinity(), -2.5f, nan}));
+        CHECK(float(numeric_limits<float16>::max()) == 65504.0f);
+        CHECK(check_half_roundtrip<bfloat16>({float(numeric_limits<bfloat16>::max()), 0x1p-133f, 1.0f + 0x1p-8f, 1.0f + 0x3p-8f, -3.0f, nan},
+                                             {0x1.fep127f, 0x1p-133f, 1.0f, 1.0f + 0x1p-6f, -3.0f, nan}));
+
+        /*expressions compute in float and round only on the store, 2a overflows float16.*/
+        Vector<float16> h(100, float16(40000.0f));
+        Vector<float16> r = h + h - h;
+        CHECK(r.at(0) == 40000.0f && r.at(99) == 40000.0f);
+        Vector<float16> twice = h + h;
+        CHECK(float(twice.at(50)) == numeric_limits<float>::infinity());
+
+        /*sum() accumulates in float, in float16 it would stall at 2048.*/
+        Vector<float16> ones(5000, float16(1.0f));
+        CHECK(ones.sum() == 5000.0f);
+        Vector<bfloat16> bones(1000, bfloat16(1.0f));
+        CHECK(bones.sum() == 1000.0f);
+
+        /*K = 600 runs over several KC panels.*/
+        CHECK(check_half_gemm<float16>(37, 600, 29));
+        CHECK(check_half_gemm<bfloat16>(19, 300, 41));
+        CHECK(check_half_gemm<float16>(5, 7, 3));
+
+        /*.npy stores float16 as "<f2".*/
+        Mat<float16> m(5, 7);
+        for(size_t i = 0; i < 35; ++i)
+            m.at(i / 7, i % 7) = float(i) * 0.25f - 3.0f;
+        m.at(1, 1) = float16::from_raw(0x0001);
+        stringstream ss;
+        m.save(ss);
+        CHECK(ss.str().find("'<f2'") != string::npos);
+        auto ml = Mat<float16>::load(ss);
+        CHECK(ml.rows() == 5 && ml.cols() == 7);
+        bool same = true;
+        for(size_t i = 0; i < 35; ++i)
+            same = same && ml.at(i / 7, i % 7).bits == m.at(i / 7, i % 7).bits;
+        CHECK(same);
+    }
+
+    {
+        cout << "**************part16 View Algebra************" << endl;
+        for(bool pad: {false, true}){
+            zmat::mat_set_row_padding(pad);
+            const size_t H = 4, W = 5, C = 3;
+
+            /*an HWC image seen as CHW, then as C rows of H * W pixels, all without copying.*/
+            Matrix<float, 3> hwc({H, W, C});
+            for(size_t y = 0; y < H; ++y)
+                for(size_t x = 0; x < W; ++x)
+                    for(size_t c = 0; c < C; ++c)
+                        hwc.at(y, x, c) = float(c * 100 + y * 10 + x);
+            auto chw = hwc.permute<2, 0, 1>();
+            CHECK(chw.size(0) == C && chw.size(1) == H && chw.size(2) == W);
+            CHECK(chw.at(2, 3, 4) == 234.0f && chw.raw_begin() == hwc.raw_begin());
+            auto planes = chw.reshaped(C, H * W);
+            CHECK(planes.raw_begin() == hwc.raw_begin());
+            CHECK(planes.at(1, 2 * W + 3) == 123.0f && planes.at(2, H * W - 1) == 234.0f);
+            planes.at(0, 0) = -1.0f;
+            CHECK(hwc.at(0, 0, 0) == -1.0f);
+
+            /*a row view split into two axes and merged back, a column view split across rows.*/
+            Mat<int> m(6, 8);
+            for(size_t i = 0; i < 6; ++i)
+                for(size_t j = 0; j < 8; ++j)
+                    m.at(i, j) = int(i * 8 + j);
+            auto row = m.row_view(3);
+            auto split = row.reshaped(2, 4);
+            CHECK(split.raw_begin() == row.raw_begin() && split.at(1, 2) == 30);
+            auto merged = split.reshaped(1, 8);
+            CHECK(merged.raw_begin() == row.raw_begin() && merged == row);
+            auto col = m.col_view(5);
+            auto pairs = col.reshaped(3, 2);
+            CHECK(pairs.raw_begin() == col.raw_begin() && pairs.at(2, 1) == 45 && pairs.at(1, 0) == 21);
+
+            /*the transpose has no steps for a row-major reshape: reshape throws, reshaped copies.*/
+            auto mt = m.t();
+            bool thrown = false;
+            try{ mt.reshape(6, 8); }catch(const std::logic_error&){ thrown = true; }
+            CHECK(thrown);
+            CHECK(mt.rows() == 8 && mt.cols() == 6);
+            auto flat = mt.reshaped(6, 8);
+            CHECK(flat.raw_begin() != m.raw_begin());
+            bool order = true;
+            for(size_t k = 0; k < 48; ++k)
+                order = order && flat.at(k / 8, k % 8) == mt.at(k / 6, k % 6);
+            CHECK(order);
+
+            /*expand_dims and squeeze undo each other on every axis.*/
+            for(size_t axis = 0; axis <= 2; ++axis){
+                auto e = m.expand_dims(axis);
+                CHECK(e.size(axis) == 1 && e.size() == m.size() && e.raw_begin() == m.raw_begin());
+                CHECK(e.is_continuous() == m.is_continuous());
+                auto back = e.squeeze(axis);
+                CHECK(back.rows() == m.rows() && back.cols() == m.cols() && back.step(0) == m.step(0) && back == m);
+            }
+            thrown = false;
+            try{ m.squeeze(0); }catch(const std::invalid_argument&){ thrown = true; }
+            CHECK(thrown);
+        }
+        zmat::mat_set_row_padding(false);
+    }
+
+    {
+        cout << "**************part17 Batched Matmul************" << endl;
+        const size_t B = 5, M = 7, K = 300, N = 9;
+        Matrix<float, 3> a({B, M, K}), b({B, K, N});
+        Mat<float> w(K, N);
+        fill_small(a, 1);
+        fill_small(b, 2);
+        fill_small(w, 3);
+        CHECK(check_bmm(a, b));
+        CHECK(check_bmm(a, w));
+        CHECK(check_bmm(Mat<float>(a[2]), b));
+
+        /*operands that are permuted views: batch in the middle, b stored transposed.*/
+        Matrix<double, 3> am({M, B, K}), bt({B, N, K});
+        fill_small(am, 4);
+        fill_small(bt, 5);
+        CHECK(check_bmm(am.permute<1, 0, 2>(), bt.permute<0, 2, 1>()));
+        Matrix<int, 3> ai({3, 4, 6}), bi({3, 6, 2});
+        fill_small(ai, 6);
+        fill_small(bi, 7);
+        CHECK(check_bmm(ai, bi));
+
+        /*the preallocated result has to match in shape and must not overlap an operand.*/
+        Matrix<float, 3> c({B, M, N});
+        zmat::bmm(a, b, c);
+        CHECK(c == zmat::bmm(a, b));
+        Matrix<float, 3> wrong({B + 1, M, N});
+        bool thrown = false;
+        try{ zmat::bmm(a, b, wrong); }catch(const std::invalid_argument&){ thrown = true; }
+        CHECK(thrown);
+        Matrix<float, 3> sq({B, M, M}), sb({B, M, M});
+        fill_small(sq, 8);
+        fill_small(sb, 9);
+        thrown = false;
+        try{ zmat::bmm(sq, sb, sq); }catch(const std::invalid_argument&){ thrown = true; }
+        CHECK(thrown);
+        auto sbt = sb.permute<0, 2, 1>();
+        thrown = false;
+        try{ zmat::bmm(sq, sb, sbt); }catch(const std::invalid_argument&){ thrown = true; }
+        CHECK(thrown);
+    }
+
+    {
+        cout << "**************part18 Gemm************" << endl;
+        auto best = zmat::mat_get_simd_level();
+        size_t threads = zmat::mat_get_num_threads(), threshold = zmat::mat_get_parallel_threshold();
+        for(bool parallel: {false, true}){
+            /*a threshold of 1 splits even the smallest products between the threads.*/
+            if(parallel){
+                zmat::mat_set_num_threads(4);
+                zmat::mat_set_parallel_threshold(1);
+            }
+            for(int lv = zmat::SIMD_GENERIC; lv <= best; ++lv){
+                zmat::mat_set_simd_level(zmat::SimdLevel(lv));
+                cout << zmat::mat_simd_level_name(zmat::SimdLevel(lv)) << (parallel? " parallel": "") << endl;
+                /*sizes off the MR/NR multiples, K across several KC panels, M across MC.*/
+                for(auto [M, K, N]: {tuple<size_t, size_t, size_t>{1, 1, 1}, {5, 3, 7}, {13, 31, 19}, {37, 517, 29}, {173, 259, 67}}){
+                    CHECK(check_gemm<float>(M, K, N));
+                    CHECK(check_gemm<double>(M, K, N));
+                    CHECK(check_gemm<int>(M, K, N));
+                }
+            }
+        }
+        zmat::mat_set_simd_level(best);
+        zmat::mat_set_num_threads(threads);
+        zmat::mat_set_parallel_threshold(threshold);
+    }
+
+    {
+        cout << "**************part19 Text Input************" << endl;
+        Mat<double> expect = {{1, 2.5, -3}, {4, 5, 6e2}};
+
+        CHECK(Mat<double>::from_text("1 2.5 -3\n4\t5  +6e2\n") == expect);
+        CHECK(Mat<double>::from_text("1,2.5,-3\r\n4,5,6e2\r\n", ',') == expect);
+        /*no newline after the last row, blank lines are skipped.*/
+        CHECK(Mat<double>::from_text("\n1,2.5,-3\n\n4,5,6e2", ',') == expect);
+        CHECK(Mat<double>::from_text("a,b,c\r\n# units\r\n1, 2.5, -3\r\n4, 5, 6e2", ',', 2) == expect);
+        CHECK(Mat<double>::from_text("1 2.5 -3\n4 5 6e2\n", {2, 3}) == expect);
+
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1,2,3\n4,5\n", ','); }, "row 1: 2 values, expected 3"));
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1,2\n3,4,5\n", ','); }, "row 1: more than 2 values"));
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1,2\n3,x4\n", ','); }, "row 1: cannot parse 'x4'"));
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1,2\n3,4.5\n", ','); }, "cannot parse '4.5'"));
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1,,2\n", ','); }, "cannot parse ''"));
+        CHECK(throws_with<std::invalid_argument>([]{ Mat<int>::from_text("1 2\n3 4\n", {3, 2}); }, "expected 3"));
+
+        /*large enough to be parsed in several chunks, an error in a late chunk still names its row.*/
+        size_t threads = zmat::mat_get_num_threads(), threshold = zmat::mat_get_parallel_threshold();
+        zmat::mat_set_num_threads(4);
+        zmat::mat_set_parallel_threshold(1);
+        const size_t R = 2000, C = 7;
+        string text = "header\r\n";
+        Mat<float> big(R, C);
+        for(size_t i = 0; i < R; ++i){
+            for(size_t j = 0; j < C; ++j){
+                big.at(i, j) = float(i) * 0.5f - float(j);
+                text += to_string(big.at(i, j)) + (j + 1 < C? ",": "");
+            }
+            text += i % 3? "\n": "\r\n";
+        }
+        CHECK(Mat<float>::from_text(text, ',', 1) == big);
+
+        auto path = (filesystem::temp_directory_path() / "zmat_example.csv").string();
+        ofstream(path, ios::binary) << text;
+        CHECK(Mat<float>::from_csv(path, ',', 1) == big);
+        CHECK(Mat<float>::from_csv(path, {R, C}, ',', 1) == big);
+        filesystem::remove(path);
+
+        string bad = text;
+        bad.replace(bad.rfind("\n", bad.size() - 2) + 1, 1, "?");
+        CHECK(throws_with<std::invalid_argument>([&]{ Mat<float>::from_text(bad, ',', 1); }, "row " + to_string(R - 1) + ": cannot parse"));
+        zmat::mat_set_num_threads(threads);
+        zmat::mat_set_parallel_threshold(threshold);
+    }
+
+    {
+        cout << "**************part20 Npy Files************" << endl;
+        for(bool pad: {false, true}){
+            zmat::mat_set_row_padding(pad);
+            Mat<double> m(9, 11);
+            for(size_t i = 0; i < 9; ++i)
+                for(size_t j = 0; j < 11; ++j)
+                    m.at(i, j) = double(i) * 100 + double(j) + 0.25;
+
+            /*views that are not continuous are streamed out in rows (or elements) of the walk.*/
+            for(const Mat<double>& v: {m, m.view(2, 7, 3, 10), m.t(), Mat<double>(m.t().view(1, 9, 0, 4))}){
+                stringstream ss;
+                v.save(ss);
+                auto back = Mat<double>::load(ss);
+                CHECK(back.rows() == v.rows() && back.cols() == v.cols() && back == v);
+                CHECK(back.step(0) == zmat::internal::padded_pitch(v.cols(), sizeof(double)));
+            }
+            Matrix<double, 3> cube({3, 4, 5});
+            fill_small(cube, 1);
+            auto perm = cube.permute<2, 0, 1>();
+            stringstream ss;
+            perm.save(ss);
+            CHECK((Matrix<double, 3>::load(ss) == perm));
+        }
+        zmat::mat_set_row_padding(false);
+
+        /*an N-D int type, through a file.*/
+        Matrix<int16_t, 4> nd({2, 3, 4, 5});
+        fill_small(nd, 2);
+        nd.at(1, 2, 3, 4) = numeric_limits<int16_t>::min();
+        auto path = (filesystem::temp_directory_path() / "zmat_example.npy").string();
+        nd.save(path);
+        auto nd_back = Matrix<int16_t, 4>::load(path);
+        filesystem::remove(path);
+        CHECK(nd_back.size(0) == 2 && nd_back.size(3) == 5 && nd_back == nd);
+
+        stringstream ss;
+        nd.save(ss);
+        string header = ss.str().substr(0, 128);
+        CHECK(header.find("'descr': '<i2'") != string::npos && header.find("'shape': (2, 3, 4, 5)") != string::npos);
+
+        /*the element type and the dimension have to match the file.*/
+        string bytes = ss.str();
+        CHECK(throws_with<std::invalid_argument>([&]{ stringstream in(bytes); Matrix<int32_t, 4>::load(in); }, "element type mismatch"));
+        CHECK(throws_with<std::invalid_argument>([&]{ stringstream in(bytes); Matrix<uint16_t, 4>::load(in); }, "element type mismatch"));
+        CHECK(throws_with<std::invalid_argument>([&]{ stringstream in(bytes); Matrix<int16_t, 3>::load(in); }, "dimension mismatch"));
+        CHECK(throws_with<std::runtime_error>([&]{ stringstream in(bytes.substr(0, bytes.size() - 2)); Matrix<int16_t, 4>::load(in); }, "unexpected end"));
+
+        /*column-major data is loaded with reversed steps.*/
+        Mat<int> cm(3, 4);
+        fill_small(cm, 3);
+        stringstream cs;
+        cm.save(cs);
+        string fortran = cs.str();
+        fortran.replace(fortran.find("False"), 5, "True ");
+        stringstream fin(fortran);
+        auto fm = Mat<int>::load(fin);
+        bool same = fm.rows() == 3 && fm.cols() == 4;
+        for(size_t k = 0; same && k < 12; ++k)
+            same = fm.at(k % 3, k / 3) == cm.at(k / 4, k % 4);
+        CHECK(same);
+    }
+
+    {
+        cout << "**************part21 Allocation Cache************" << endl;
+        auto steady_loop = []{
+            for(int i = 0; i < 100; ++i){
+                Mat<float> m(50, 50, 1.0f);
+                Mat<float> n = m + m;
+                if(n.at(49, 49) != 2.0f)
+                    return false;
+            }
+            return true;
+        };
+
+        /*after the first round every buffer comes back from the free list of this thread.*/
+        zmat::mat_alloc_trim();
+        auto before = zmat::mat_get_alloc_stats();
+        CHECK(steady_loop());
+        auto after = zmat::mat_get_alloc_stats();
+        CHECK(after.allocations - before.allocations >= 200);
+        CHECK(after.cache_hits - before.cache_hits >= 198);
+        CHECK(after.cached_bytes >= before.cached_bytes + 50 * 50 * sizeof(float) * 2);
+
+        /*trim hands the cached bytes of this thread back to the system.*/
+        size_t freed = zmat::mat_alloc_trim();
+        auto trimmed = zmat::mat_get_alloc_stats();
+        CHECK(freed >= 50 * 50 * sizeof(float) * 2);
+        CHECK(trimmed.cached_bytes == after.cached_bytes - freed);
+        CHECK(zmat::mat_alloc_trim() == 0);
+
+        /*with no room in the cache nothing is kept, so nothing is reused.*/
+        size_t limit = zmat::mat_get_alloc_cache_limit();
+        zmat::mat_set_alloc_cache_limit(0);
+        before = zmat::mat_get_alloc_stats();
+        CHECK(steady_loop());
+        after = zmat::mat_get_alloc_stats();
+        CHECK(after.cache_hits == before.cache_hits && after.cached_bytes == before.cached_bytes);
+        zmat::mat_set_alloc_cache_limit(limit);
+
+        /*the system allocator bypasses the counters.*/
+        auto alloc = zmat::mat_get_allocator();
+        zmat::mat_set_allocator(zmat::mat_system_allocator());
+        before = zmat::mat_get_alloc_stats();
+        CHECK(steady_loop());
+        after = zmat::mat_get_alloc_stats();
+        CHECK(after.allocations == before.allocations);
+        zmat::mat_set_allocator(alloc);
+    }
+
+    if(failures)
+        cout << failures << " checks failed" << endl;
+    return failures != 0;
+}
@@ -0,0 +1,231 @@
+#include "kernel/data.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zmat{
+
+namespace internal{
+
+static std::runtime_error file_error(const std::string& what, const std::string& path){
+    return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+void* map_file(const std::string& path, size_t offset, size_t bytes, MapMode mode, void*& base, size_t& length){
+    bool writable = mode == MAP_MODE_SHARED;
+    int fd = ::open(path.c_str(), writable? O_RDWR | O_CREAT: O_RDONLY, 0644);
+    if(fd < 0)
+        throw file_error("cannot open", path);
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0){
+        ::close(fd);
+        throw file_error("cannot stat", path);
+    }
+    if(static_cast<size_t>(st.st_size) < offset + bytes){
+        if(!writable){
+            ::close(fd);
+            throw std::invalid_argument("file '" + path + "' is smaller than the requested matrix");
+        }
+        if(::ftruncate(fd, offset + bytes) != 0){
+            ::close(fd);
+            throw file_error("cannot extend", path);
+        }
+    }
+
+    size_t page = ::sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    length = offset + bytes - start;
+
+    int prot = mode == MAP_MODE_READ? PROT_READ: PROT_READ | PROT_WRITE;
+    int flags = mode == MAP_MODE_SHARED? MAP_SHARED: MAP_PRIVATE;
+    base = ::mmap(nullptr, length, prot, flags, fd, start);
+    ::close(fd);
+    if(base == MAP_FAILED)
+        throw file_error("cannot map", path);
+
+    return static_cast<char*>(base) + (offset - start);
+}
+
+void unmap_file(void* base, size_t length){
+    ::munmap(base, length);
+}
+
+size_t file_size(const std::string& path){
+    struct stat st;
+    if(::stat(path.c_str(), &st) != 0)
+        throw file_error("cannot stat", path);
+    return st.st_size;
+}
+
+void advise_mapping(const void* ptr, size_t bytes, bool will_need){
+    uintptr_t page = ::sysconf(_SC_PAGESIZE);
+    uintptr_t l = reinterpret_cast<uintptr_t>(ptr) / page * page;
+    uintptr_t r = reinterpret_cast<uintptr_t>(ptr) + bytes;
+    ::madvise(reinterpret_cast<void*>(l), r - l, will_need? MADV_WILLNEED: MADV_DONTNEED);
+}
+
+static const char NPY_MAGIC[] = "\x93NUMPY";
+
+std::string npy_header(const std::string& descr, bool fortran_order, const size_t* shape, size_t dim){
+    std::string dict = "{'descr': '" + descr + "', 'fortran_order': " + (fortran_order? "True": "False") + ", 'shape': (";
+    for(size_t i = 0; i < dim; ++i)
+        dict += std::to_string(shape[i]) + (dim == 1 || i + 1 < dim? ", ": "");
+    dict += "), }";
+
+    /*version 1.0 stores the length in 2 bytes, 2.0 in 4; the total is padded to 64 bytes.*/
+    size_t prefix = dict.size() + 1 < 65536 - 10? 10: 12;
+    size_t total = (prefix + dict.size() + 1 + 63) / 64 * 64;
+    dict.append(total - prefix - dict.size() - 1, ' ');
+    dict += '\n';
+
+    std::string res(NPY_MAGIC, 6);
+    size_t len = dict.size();
+    if(prefix == 10){
+        res += '\x01';
+        res += '\x00';
+        res += static_cast<char>(len & 0xff);
+        res += static_cast<char>(len >> 8 & 0xff);
+    }else{
+        res += '\x02';
+        res += '\x00';
+        for(int i = 0; i < 4; ++i)
+            res += static_cast<char>(len >> (8 * i) & 0xff);
+    }
+    return res + dict;
+}
+
+/*value following 'key': in the header dict, up to the matching delimiter.*/
+static std::string npy_field(const std::string& dict, const std::string& key){
+    size_t pos = dict.find("'" + key + "'");
+    if(pos == std::string::npos)
+        throw std::invalid_argument("malformed .npy header: missing " + key);
+    pos = dict.find(':', pos);
+    if(pos == std::string::npos)
+        throw std::invalid_argument("malformed .npy header: missing value of " + key);
+    pos = dict.find_first_not_of(' ', pos + 1);
+    if(pos == std::string::npos)
+        throw std::invalid_argument("malformed .npy header: missing value of " + key);
+
+    size_t end;
+    if(dict[pos] == '\'' || dict[pos] == '"'){
+        end = dict.find(dict[pos], pos + 1);
+        ++pos;
+    }else if(dict[pos] == '('){
+        end = dict.find(')', pos);
+        ++pos;
+    }else{
+        end = dict.find_first_of(",}", pos);
+        /*a bare value may be followed by spaces before its delimiter.*/
+        while(end != std::string::npos && end > pos && dict[end - 1] == ' ')
+            --end;
+    }
+    if(end == std::string::npos)
+        throw std::invalid_argument("malformed .npy header: unterminated value of " + key);
+    return dict.substr(pos, end - pos);
+}
+
+void npy_read_header(std::istream& in, std::string& descr, bool& fortran_order, std::vector<size_t>& shape){
+    char pre[8];
+    if(!in.read(pre, 8) || std::memcmp(pre, NPY_MAGIC, 6) != 0)
+        throw std::invalid_argument("not a .npy file");
+
+    size_t len = 0;
+    unsigned char buf[4] = {};
+    int width = pre[6] == 1? 2: 4;
+    if(!in.read(reinterpret_cast<char*>(buf), width))
+        throw std::invalid_argument("malformed .npy header");
+    for(int i = width; i-- > 0;)
+        len = len << 8 | buf[i];
+
+    std::string dict(len, '\0');
+    if(!in.read(dict.data(), len))
+        throw std::invalid_argument("malformed .npy header");
+
+    descr = npy_field(dict, "descr");
+    if(descr.size() > 1 && descr[0] == '=')
+        descr[0] = '<';
+    fortran_order = npy_field(dict, "fortran_order") == "True";
+
+    shape.clear();
+    std::string dims = npy_field(dict, "shape");
+    for(size_t pos = 0; pos < dims.size();){
+        pos = dims.find_first_of("0123456789", pos);
+        if(pos == std::string::npos)
+            break;
+        size_t used;
+        shape.push_back(std::stoull(dims.substr(pos), &used));
+        pos += used;
+    }
+}
+
+static bool is_blank(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* line_end(const char* p, const char* end){
+    auto q = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return q? q: end;
+}
+
+bool text_blank_line(const char* p, const char* end){
+    for(; p != end; ++p)
+        if(!is_blank(*p))
+            return false;
+    return true;
+}
+
+const char* text_skip_lines(const char* p, const char* end, size_t n){
+    for(; n && p != end; --n){
+        p = line_end(p, end);
+        if(p != end)
+            ++p;
+    }
+    return p;
+}
+
+std::vector<const char*> text_chunks(const char* begin, const char* end, size_t parts){
+    std::vector<const char*> res{begin};
+    size_t len = end - begin;
+    for(size_t i = 1; i < parts; ++i){
+        const char* p = begin + len * i / parts;
+        if(p < res.back())
+            p = res.back();
+        p = line_end(p, end);
+        res.push_back(p == end? end: p + 1);
+    }
+    res.push_back(end);
+    return res;
+}
+
+size_t text_count_rows(const char* p, const char* end){
+    size_t rows = 0;
+    while(p != end){
+        const char* q = line_end(p, end);
+        rows += !text_blank_line(p, q);
+        p = q == end? end: q + 1;
+    }
+    return rows;
+}
+
+size_t text_count_fields(const char* p, const char* end, char delim){
+    if(delim != ' ')
+        return std::count(p, end, delim) + 1;
+    size_t cnt = 0;
+    for(bool in_field = false; p != end; ++p){
+        bool blank = is_blank(*p);
+        cnt += in_field == false && !blank;
+        in_field = !blank;
+    }
+    return cnt;
+}
+
+
+} // namespace internal
+
+} // namespace zmat
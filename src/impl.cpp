@@ -1,4 +1,14 @@
 #include "kernel/utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace zmat{
 
@@ -16,6 +26,196 @@ std::logic_error error_invalid_use(){
 
 namespace internal{
 double mat_setting::eps = 1e-9;
+size_t mat_setting::num_threads = 0;
+size_t mat_setting::parallel_threshold = 1 << 18;
+size_t mat_setting::alignment = 64;
+bool mat_setting::row_padding = false;
+
+size_t parallel_threads(size_t work){
+#ifdef _OPENMP
+    if(work < mat_setting::parallel_threshold || omp_in_parallel())
+        return 1;
+    return mat_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+void* system_allocate(size_t bytes, size_t align){
+    return ::operator new(bytes, std::align_val_t(align));
+}
+
+void system_deallocate(void* ptr, size_t, size_t align){
+    ::operator delete(ptr, std::align_val_t(align));
+}
+
+/*
+    Size classes: everything up to 64 bytes is class 0, above that each
+    power of two is split into four classes, so a buffer is at most 25%
+    larger than requested.
+*/
+constexpr size_t ALLOC_CLASSES = 4 * 64;
+
+size_t size_class(size_t bytes, size_t& class_bytes){
+    if(bytes <= 64){
+        class_bytes = 64;
+        return 0;
+    }
+    size_t e = 63 - __builtin_clzll(bytes - 1);     //2^e < bytes <= 2^(e+1)
+    size_t quarter = size_t(1) << (e - 2);
+    size_t k = (bytes - (size_t(1) << e) + quarter - 1) / quarter;
+    class_bytes = (size_t(1) << e) + k * quarter;
+    return (e - 5) * 4 + k - 4;
+}
+
+std::atomic<size_t> alloc_count{0}, alloc_hits{0}, alloc_cached{0};
+
+struct alloc_cache{
+    std::vector<void*> lists[ALLOC_CLASSES];
+    size_t bytes = 0;
+
+    size_t trim(){
+        size_t res = bytes;
+        for(auto& list: lists){
+            for(void* ptr: list)
+                std::free(ptr);
+            list.clear();
+        }
+        alloc_cached -= bytes;
+        bytes = 0;
+        return res;
+    }
+
+    ~alloc_cache();
+};
+
+thread_local alloc_cache local_cache;
+thread_local bool local_cache_alive = true;     //false once local_cache is destroyed
+
+alloc_cache::~alloc_cache(){
+    trim();
+    local_cache_alive = false;
+}
+
+/*quarter class sizes (80, 96, 112, ...) need not be multiples of the alignment, aligned_alloc wants one: round up to it.*/
+size_t alloc_capacity(size_t class_bytes, size_t align){
+    return (class_bytes + align - 1) / align * align;
+}
+
+void* caching_allocate(size_t bytes, size_t align){
+    size_t class_bytes;
+    size_t c = size_class(bytes, class_bytes);
+    ++alloc_count;
+
+    if(local_cache_alive){
+        auto& list = local_cache.lists[c];
+        for(size_t i = list.size(); i-- > 0;){
+            void* ptr = list[i];
+            if(reinterpret_cast<uintptr_t>(ptr) % align == 0){
+                list[i] = list.back();
+                list.pop_back();
+                local_cache.bytes -= class_bytes;
+                alloc_cached -= class_bytes;
+                ++alloc_hits;
+                return ptr;
+            }
+        }
+    }
+
+    align = std::max<size_t>(align, 64);
+    void* ptr = std::aligned_alloc(align, alloc_capacity(class_bytes, align));
+    if(ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void caching_deallocate(void* ptr, size_t bytes, size_t){
+    size_t class_bytes;
+    size_t c = size_class(bytes, class_bytes);
+    if(!local_cache_alive || local_cache.bytes + class_bytes > mat_setting::alloc_cache_limit){
+        std::free(ptr);
+        return;
+    }
+    local_cache.lists[c].push_back(ptr);
+    local_cache.bytes += class_bytes;
+    alloc_cached += class_bytes;
+}
+
+mat_allocator mat_setting::allocator = {caching_allocate, caching_deallocate};
+size_t mat_setting::alloc_cache_limit = size_t(1) << 30;
+size_t mat_setting::memory_budget = size_t(1) << 30;
+
+SimdLevel initial_simd_level(){
+    SimdLevel best = mat_detect_simd_level();
+    const char* env = std::getenv("ZMAT_SIMD");
+    if(env == nullptr)
+        return best;
+    for(int l = SIMD_GENERIC; l <= best; ++l){
+        if(std::strcmp(env, mat_simd_level_name(SimdLevel(l))) == 0)
+            return SimdLevel(l);
+    }
+    return best;
+}
+
+bool cpu_has_vnni(){
+#ifdef _MAT_X86
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("avx512vnni"));
+    return has;
+#else
+    return false;
+#endif
+}
+
+/*zero (generic) until this runs, so kernels called during static initialization stay safe.*/
+SimdLevel mat_setting::simd_level = initial_simd_level();
+
+size_t padded_pitch(size_t cols, size_t elem){
+    size_t align = mat_setting::alignment;
+    if(!mat_setting::row_padding || align % elem != 0)
+        return cols;
+    size_t bytes = (cols * elem + align - 1) / align * align;
+    if(bytes % 4096 == 0)
+        bytes += align;
+    return bytes / elem;
+}
+
+bool reshape_steps(const size_t* sizes, const size_t* steps, size_t dim,
+                   const size_t* nsizes, size_t* nsteps, size_t ndim){
+    /*axes of size 1 carry no layout, the others are matched in groups of equal products.*/
+    std::vector<size_t> osiz, ostp;
+    for(size_t i = 0; i < dim; ++i){
+        if(sizes[i] != 1){
+            osiz.push_back(sizes[i]);
+            ostp.push_back(steps[i]);
+        }
+    }
+
+    size_t oi = 0, ni = 0;
+    while(oi < osiz.size() && ni < ndim){
+        size_t oj = oi + 1, nj = ni + 1;
+        size_t op = osiz[oi], np = nsizes[ni];
+        while(op != np){
+            if(np < op)
+                np *= nsizes[nj++];
+            else
+                op *= osiz[oj++];
+        }
+        /*the old axes of a group must walk the memory as a single one.*/
+        for(size_t k = oi; k + 1 < oj; ++k){
+            if(ostp[k] != osiz[k + 1] * ostp[k + 1])
+                return false;
+        }
+        nsteps[nj - 1] = ostp[oj - 1];
+        for(size_t k = nj - 1; k > ni; --k)
+            nsteps[k - 1] = nsteps[k] * nsizes[k];
+        oi = oj;
+        ni = nj;
+    }
+    /*trailing axes of size 1.*/
+    for(; ni < ndim; ++ni)
+        nsteps[ni] = 1;
+    return true;
+}
 }
 
 void mat_set_eps(double eps){
@@ -24,7 +224,127 @@ void mat_set_eps(double eps){
 
 double mat_get_eps(){
     return internal::mat_setting::eps;
+}
+
+void mat_set_num_threads(size_t num){
+    internal::mat_setting::num_threads = num;
+}
+
+size_t mat_get_num_threads(){
+#ifdef _OPENMP
+    if(internal::mat_setting::num_threads == 0)
+        return omp_get_max_threads();
+#endif
+    return std::max<size_t>(internal::mat_setting::num_threads, 1);
+}
+
+void mat_set_parallel_threshold(size_t work){
+    internal::mat_setting::parallel_threshold = work;
+}
+
+size_t mat_get_parallel_threshold(){
+    return internal::mat_setting::parallel_threshold;
+}
+
+void mat_set_alignment(size_t bytes){
+    if(bytes == 0 || (bytes & (bytes - 1)) != 0)
+        throw std::invalid_argument("alignment must be a power of two");
+    internal::mat_setting::alignment = bytes;
+}
+
+size_t mat_get_alignment(){
+    return internal::mat_setting::alignment;
+}
+
+void mat_set_row_padding(bool pad){
+    internal::mat_setting::row_padding = pad;
+}
+
+bool mat_get_row_padding(){
+    return internal::mat_setting::row_padding;
+}
+
+mat_allocator mat_system_allocator(){
+    return {internal::system_allocate, internal::system_deallocate};
+}
+
+mat_allocator mat_caching_allocator(){
+    return {internal::caching_allocate, internal::caching_deallocate};
+}
+
+void mat_set_allocator(const mat_allocator& alloc){
+    if(alloc.allocate == nullptr || alloc.deallocate == nullptr)
+        throw std::invalid_argument("allocator functions cannot be null");
+    internal::mat_setting::allocator = alloc;
+}
+
+mat_allocator mat_get_allocator(){
+    return internal::mat_setting::allocator;
+}
+
+void mat_set_alloc_cache_limit(size_t bytes){
+    internal::mat_setting::alloc_cache_limit = bytes;
+}
+
+size_t mat_get_alloc_cache_limit(){
+    return internal::mat_setting::alloc_cache_limit;
+}
+
+void mat_set_memory_budget(size_t bytes){
+    internal::mat_setting::memory_budget = bytes;
+}
+
+size_t mat_get_memory_budget(){
+    return internal::mat_setting::memory_budget;
+}
+
+SimdLevel mat_detect_simd_level(){
+#ifdef _MAT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse4.2"))
+        return SIMD_SSE42;
+#endif
+    return SIMD_GENERIC;
+}
+
+void mat_set_simd_level(SimdLevel level){
+    if(level < SIMD_GENERIC || level > SIMD_AVX512)
+        throw std::invalid_argument("unknown simd level");
+    if(level > mat_detect_simd_level())
+        throw std::invalid_argument(zutil::as_str("the cpu does not support ", mat_simd_level_name(level)));
+    internal::mat_setting::simd_level = level;
+}
+
+SimdLevel mat_get_simd_level(){
+    return internal::mat_setting::simd_level;
+}
+
+const char* mat_simd_level_name(SimdLevel level){
+    switch(level){
+    case SIMD_SSE42:
+        return "sse4.2";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    default:
+        return "generic";
+    }
+}
+
+mat_alloc_stats mat_get_alloc_stats(){
+    return {internal::alloc_count, internal::alloc_hits, internal::alloc_cached};
+}
+
+size_t mat_alloc_trim(){
+    if(!internal::local_cache_alive)
+        return 0;
+    return internal::local_cache.trim();
 
     
 } // namespace internal
-}; //namespace zmat
\ No newline at end of file
+}; //namespace zmat